@@ -0,0 +1,22 @@
+// Host-side decoder of the logs of the devices: rebuilds the text of deferred log records.
+// Reads the logs from stdin, writes them decoded to stdout (other lines are left untouched).
+
+#define LOG_FORMATS_DECODER // keep the formats of retired entries too
+
+#include <LogCodec.h>
+
+#define LINE_MAX_LENGTH 1024
+
+int main(int argc, const char *argv[]) {
+  char line[LINE_MAX_LENGTH];
+  char decoded[LINE_MAX_LENGTH];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    char *rec = strchr(line, LOG_DEFERRED_MARK);
+    if (rec != NULL && logDecodeRecord(rec, decoded, sizeof(decoded))) {
+      printf("%.*s%s\n", (int)(rec - line), line, decoded);
+    } else {
+      fputs(line, stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef ALLOC_COUNTER_INC
+#define ALLOC_COUNTER_INC
+
+#include <log4ino/Log.h>
+#include <stddef.h>
+
+#define CLASS_ALLOC_COUNTER "AC"
+
+#ifndef ALLOC_LOOP_BUDGET
+#define ALLOC_LOOP_BUDGET -1 // maximum allocations per loop once setup is done (-1 means no budget)
+#endif // ALLOC_LOOP_BUDGET
+
+/**
+ * Subsystems allocations are accounted to (innermost scope wins).
+ */
+enum AllocSubsystem {
+  AllocOther = 0,   // anything out of a scope
+  AllocSetup,       // setup
+  AllocLoop,        // module loop (not accounted to a more specific subsystem)
+  AllocRun,         // run / configure mode of the architecture
+  AllocCommand,     // commands
+  AllocLog,         // log lines
+  AllocSync,        // http requests
+  AllocEmulation,   // emulation of the hardware in the simulator (not accounted to the loop budget)
+  AllocDelimiter
+};
+
+const char *AllocSubsystemNames[AllocDelimiter] = {"other", "setup", "loop", "run", "command", "log", "sync", "emulation"};
+
+/**
+ * Counter of heap allocations (calls and bytes), per subsystem and per loop.
+ *
+ * Fed by the allocator (only instrumented in the simulator, when ALLOC_COUNTING_ENABLED),
+ * so it must never allocate itself.
+ */
+class AllocCounter {
+
+private:
+  long calls[AllocDelimiter];
+  long bytes[AllocDelimiter];
+  AllocSubsystem current;
+  long loopCalls;  // allocations in the current loop
+  long loopBytes;
+  long loops;      // amount of loops completed
+  long loopMaxCalls;
+  long overBudget; // amount of loops over budget
+
+public:
+  AllocCounter() {
+    for (int i = 0; i < AllocDelimiter; i++) {
+      calls[i] = 0;
+      bytes[i] = 0;
+    }
+    current = AllocOther;
+    loopCalls = 0;
+    loopBytes = 0;
+    loops = 0;
+    loopMaxCalls = 0;
+    overBudget = 0;
+  }
+
+  void allocated(size_t size) {
+    calls[current]++;
+    bytes[current] += size;
+    if (current != AllocEmulation) {
+      loopCalls++;
+      loopBytes += size;
+    }
+  }
+
+  AllocSubsystem enter(AllocSubsystem s) {
+    AllocSubsystem previous = current;
+    current = s;
+    return previous;
+  }
+
+  void leave(AllocSubsystem previous) {
+    current = previous;
+  }
+
+  void beginLoop() {
+    loopCalls = 0;
+    loopBytes = 0;
+  }
+
+  /**
+   * Close a loop, returns false if its allocations went over the budget.
+   */
+  bool endLoop() {
+    loops++;
+    loopMaxCalls = (loopCalls > loopMaxCalls ? loopCalls : loopMaxCalls);
+    if (ALLOC_LOOP_BUDGET >= 0 && loopCalls > ALLOC_LOOP_BUDGET) {
+      overBudget++;
+      log(CLASS_ALLOC_COUNTER, Error, "Loop %ld over budget: %ld allocs (%ld bytes) > %d", loops, loopCalls, loopBytes, ALLOC_LOOP_BUDGET);
+      return false;
+    }
+    return true;
+  }
+
+  long getLoopCalls() {
+    return loopCalls;
+  }
+
+  long getLoopBytes() {
+    return loopBytes;
+  }
+
+  long getCalls(AllocSubsystem s) {
+    return calls[s];
+  }
+
+  long getOverBudget() {
+    return overBudget;
+  }
+
+  void report() {
+    log(CLASS_ALLOC_COUNTER, Info, "### Allocs: loops=%ld max/loop=%ld over budget=%ld", loops, loopMaxCalls, overBudget);
+    for (int i = 0; i < AllocDelimiter; i++) {
+      log(CLASS_ALLOC_COUNTER, Info, "### %s: %ld allocs, %ld bytes", AllocSubsystemNames[i], calls[i], bytes[i]);
+    }
+  }
+};
+
+AllocCounter allocCounter;
+
+/**
+ * Accounts the allocations of the enclosing block to the subsystem.
+ */
+class AllocScope {
+
+private:
+  AllocSubsystem previous;
+
+public:
+  AllocScope(AllocSubsystem s) {
+    previous = allocCounter.enter(s);
+  }
+  ~AllocScope() {
+    allocCounter.leave(previous);
+  }
+};
+
+#ifdef ALLOC_COUNTING_ENABLED
+#define ALLOC_SCOPE(s) AllocScope allocScope(s)
+#else // ALLOC_COUNTING_ENABLED
+#define ALLOC_SCOPE(s)
+#endif // ALLOC_COUNTING_ENABLED
+
+#endif // ALLOC_COUNTER_INC
@@ -0,0 +1,89 @@
+#ifndef ARENA_INC
+#define ARENA_INC
+
+#include <log4ino/Log.h>
+#include <new>
+#include <stdint.h>
+#include <stddef.h>
+
+#define CLASS_ARENA "AR"
+
+// Bytes of static storage for the long-lived objects, to be tuned after the high-water mark logged
+// at the end of setup ("Arena: used/size").
+#ifndef ARENA_SIZE
+#ifdef ARDUINO
+#define ARENA_SIZE 1024 // objects of the module (about 0.9K with 32-bit pointers)
+#else // ARDUINO
+#define ARENA_SIZE 4096 // 64-bit pointers, and room for the buffers of the input trace
+#endif // ARDUINO
+#endif // ARENA_SIZE
+
+#define ARENA_ALIGNMENT 8
+
+/**
+ * Static storage for the objects that live as long as the device is awake (module, actors, buffers, ...).
+ *
+ * Objects are constructed in place one after the other and are never released, so that they do not
+ * fragment the heap. Only the objects themselves live here: the content of a Buffer is still allocated
+ * by main4ino in the heap (once, upon construction). Being a bump allocator, the amount used is also
+ * the high-water mark. If the arena is exhausted objects go to the heap (and are counted), so that the
+ * size can be tuned.
+ */
+class Arena {
+
+private:
+  alignas(ARENA_ALIGNMENT) uint8_t storage[ARENA_SIZE];
+  size_t used;
+  int overflows;
+
+public:
+  Arena() {
+    used = 0;
+    overflows = 0;
+  }
+
+  /**
+   * Reserve aligned storage, NULL if not enough left.
+   */
+  void *allocate(size_t size) {
+    size_t aligned = (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+    if (aligned > ARENA_SIZE - used) {
+      return NULL;
+    }
+    void *p = storage + used;
+    used += aligned;
+    return p;
+  }
+
+  /**
+   * Construct an object in the arena (or in the heap if the arena is exhausted).
+   */
+  template <class T, class... Args> T *make(Args... args) {
+    void *p = allocate(sizeof(T));
+    if (p == NULL) {
+      overflows++;
+      log(CLASS_ARENA, Warn, "Full (%d/%d), heap: %d", (int)used, ARENA_SIZE, (int)sizeof(T));
+      return new T(args...);
+    }
+    return new (p) T(args...);
+  }
+
+  /**
+   * Bytes used (high-water mark).
+   */
+  size_t getUsed() {
+    return used;
+  }
+
+  size_t getSize() {
+    return ARENA_SIZE;
+  }
+
+  int getOverflows() {
+    return overflows;
+  }
+};
+
+Arena arena;
+
+#endif // ARENA_INC
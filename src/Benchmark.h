@@ -0,0 +1,107 @@
+#ifndef BENCHMARK_INC
+#define BENCHMARK_INC
+
+// Micro-benchmarks of the hot paths of the firmware, run against the x86_64 platform (see ./benchmark).
+// Each benchmark reports a line "BENCH <name> <ns/op> <allocs/op>" in the standard output.
+
+#ifndef BENCHMARK_ITERATIONS
+#define BENCHMARK_ITERATIONS 10000
+#endif // BENCHMARK_ITERATIONS
+
+#define BENCHMARK_VALUE_LENGTH 64
+#define BENCHMARK_TUNING_FILENAME "/bench.tuning"
+#define BENCHMARK_TUNING_LENGTH 16
+
+Buffer *benchValue = NULL;
+Buffer *benchTuning = NULL;
+
+void benchRun(const char *name, void (*f)(long i)) {
+  f(0); // warm up (lazy initializations are not measured)
+  allocCounter.beginLoop();
+  unsigned long start = microsArchitecture();
+  for (long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+    f(i);
+  }
+  unsigned long us = microsArchitecture() - start;
+  long allocs = allocCounter.getLoopCalls();
+  printf("BENCH %s %ld %ld.%03ld\n", name, (long)(us * 1000 / BENCHMARK_ITERATIONS), allocs / BENCHMARK_ITERATIONS,
+         (allocs * 1000 / BENCHMARK_ITERATIONS) % 1000);
+}
+
+void benchLog(long i) {
+  log(CLASS_PLATFORM, Warn, "Bench %ld: %s", i, "log");
+}
+
+void benchCommand(long i) {
+  m->command("io 1 0");
+}
+
+void benchTuningVariable(long i) {
+  initializeTuningVariable(&benchTuning, BENCHMARK_TUNING_FILENAME, BENCHMARK_TUNING_LENGTH, "bench", false);
+}
+
+void benchBatteryAct(long i) {
+  m->getBattery()->act();
+}
+
+void benchGetInteger(long i) {
+  m->getBattery()->getSetPropValue(BatteryVccNowProp, GetValue, NULL, benchValue);
+}
+
+void benchSetInteger(long i) {
+  benchValue->fill("%d", 3300 + (int)(i & 1));
+  m->getBattery()->getSetPropValue(BatteryVccNowProp, SetValue, benchValue, NULL);
+}
+
+void benchGetBoolean(long i) {
+  m->getSleepinoSettings()->getSetPropValue(SleepinoSettingsLcdLogsProp, GetValue, NULL, benchValue);
+}
+
+void benchSetBoolean(long i) {
+  benchValue->load((i & 1) ? "true" : "false");
+  m->getSleepinoSettings()->getSetPropValue(SleepinoSettingsLcdLogsProp, SetValue, benchValue, NULL);
+}
+
+void benchGetString(long i) {
+  m->getSleepinoSettings()->getSetPropValue(SleepinoSettingsStatusProp, GetValue, NULL, benchValue);
+}
+
+void benchSetString(long i) {
+  benchValue->load((i & 1) ? "bench:1" : "bench:0");
+  m->getSleepinoSettings()->getSetPropValue(SleepinoSettingsStatusProp, SetValue, benchValue, NULL);
+}
+
+void benchGetTiming(long i) {
+  m->getServon()->getSetPropValue(ServonFreqProp, GetValue, NULL, benchValue);
+}
+
+void benchSetTiming(long i) {
+  benchValue->load((i & 1) ? "~1m" : "~2m");
+  m->getServon()->getSetPropValue(ServonFreqProp, SetValue, benchValue, NULL);
+}
+
+void benchHumanize(long i) {
+  Timing::humanize(m->getClock()->currentTime() + i, benchValue);
+}
+
+/**
+ * Run all benchmarks (to be invoked once setup is done).
+ */
+void benchmarkSuite() {
+  benchValue = arena.make<Buffer>(BENCHMARK_VALUE_LENGTH);
+  benchRun("log", benchLog);
+  benchRun("command", benchCommand);
+  benchRun("tuningvariable", benchTuningVariable);
+  benchRun("batteryact", benchBatteryAct);
+  benchRun("getinteger", benchGetInteger);
+  benchRun("setinteger", benchSetInteger);
+  benchRun("getboolean", benchGetBoolean);
+  benchRun("setboolean", benchSetBoolean);
+  benchRun("getstring", benchGetString);
+  benchRun("setstring", benchSetString);
+  benchRun("gettiming", benchGetTiming);
+  benchRun("settiming", benchSetTiming);
+  benchRun("humanize", benchHumanize);
+}
+
+#endif // BENCHMARK_INC
@@ -0,0 +1,90 @@
+#ifndef COMMAND_INC
+#define COMMAND_INC
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define COMMAND_SEPARATOR ' '
+
+#define COMMAND_FNV_OFFSET 2166136261u
+#define COMMAND_FNV_PRIME 16777619u
+
+/**
+ * FNV-1a hash of a command name (up to the first separator), usable at compile time.
+ *
+ * Meant to dispatch commands with a switch over case commandHash("name"): two names
+ * colliding lead to duplicate case labels, so collisions among known commands are caught
+ * at compile time. Unknown input may still collide, hence a match must be confirmed with commandIs.
+ */
+constexpr uint32_t commandHash(const char *s, uint32_t h = COMMAND_FNV_OFFSET) {
+  return (*s == 0 || *s == COMMAND_SEPARATOR) ? h : commandHash(s + 1, (h ^ (uint8_t)*s) * COMMAND_FNV_PRIME);
+}
+
+/**
+ * Whether the token (ended by a separator or the end of the string) is the given name.
+ */
+inline bool commandIs(const char *token, const char *name) {
+  while (*name != 0 && *token == *name) {
+    token++;
+    name++;
+  }
+  return *name == 0 && (*token == 0 || *token == COMMAND_SEPARATOR);
+}
+
+/**
+ * Tokenizer of a command line that works in place (no copy, no allocation, input left untouched).
+ */
+class CommandArgs {
+
+private:
+  const char *cursor;
+
+  void skipSeparators() {
+    while (*cursor == COMMAND_SEPARATOR) {
+      cursor++;
+    }
+  }
+
+public:
+  CommandArgs(const char *line) {
+    cursor = line;
+    skipSeparators();
+  }
+
+  /**
+   * Next token (not null-terminated, ends at a separator or at the end of the line), NULL if none.
+   */
+  const char *next() {
+    skipSeparators();
+    if (*cursor == 0) {
+      return NULL;
+    }
+    const char *token = cursor;
+    while (*cursor != 0 && *cursor != COMMAND_SEPARATOR) {
+      cursor++;
+    }
+    return token;
+  }
+
+  /**
+   * Next token as an integer, returns false if none.
+   */
+  bool nextInt(int *v) {
+    const char *token = next();
+    if (token == NULL) {
+      return false;
+    }
+    *v = atoi(token); // stops at the separator
+    return true;
+  }
+
+  /**
+   * Rest of the line (may contain separators), NULL if empty.
+   */
+  const char *rest() {
+    skipSeparators();
+    return (*cursor == 0 ? NULL : cursor);
+  }
+};
+
+#endif // COMMAND_INC
@@ -0,0 +1,278 @@
+#ifndef ENERGY_METER_INC
+#define ENERGY_METER_INC
+
+#include <log4ino/Log.h>
+#include <stdint.h>
+
+#define CLASS_ENERGY_METER "EM"
+
+// Currents drawn per state (uA), defaults taken from ESP8266 / PCD8544 datasheets.
+// To be tuned via build flags for the actual hardware.
+
+#ifndef ENERGY_CPU_80MHZ_UA
+#define ENERGY_CPU_80MHZ_UA 15000 // CPU active (modem sleep) at 80MHz
+#endif // ENERGY_CPU_80MHZ_UA
+
+#ifndef ENERGY_CPU_160MHZ_UA
+#define ENERGY_CPU_160MHZ_UA 25000 // CPU active (modem sleep) at 160MHz
+#endif // ENERGY_CPU_160MHZ_UA
+
+#ifndef ENERGY_WIFI_TX_UA
+#define ENERGY_WIFI_TX_UA 170000 // radio transmitting
+#endif // ENERGY_WIFI_TX_UA
+
+#ifndef ENERGY_WIFI_RX_UA
+#define ENERGY_WIFI_RX_UA 56000 // radio receiving / listening
+#endif // ENERGY_WIFI_RX_UA
+
+#ifndef ENERGY_WIFI_TX_PERCENT
+#define ENERGY_WIFI_TX_PERCENT 20 // share of radio-on time spent transmitting
+#endif // ENERGY_WIFI_TX_PERCENT
+
+#ifndef ENERGY_LCD_UA
+#define ENERGY_LCD_UA 300 // LCD on (no backlight)
+#endif // ENERGY_LCD_UA
+
+#ifndef ENERGY_POWER_UA
+#define ENERGY_POWER_UA 150000 // POWER_PIN high (servo powered)
+#endif // ENERGY_POWER_UA
+
+#ifndef ENERGY_LIGHT_SLEEP_UA
+#define ENERGY_LIGHT_SLEEP_UA 900
+#endif // ENERGY_LIGHT_SLEEP_UA
+
+#ifndef ENERGY_DEEP_SLEEP_UA
+#define ENERGY_DEEP_SLEEP_UA 20
+#endif // ENERGY_DEEP_SLEEP_UA
+
+#ifndef BATTERY_CAPACITY_MAH
+#define BATTERY_CAPACITY_MAH 2000
+#endif // BATTERY_CAPACITY_MAH
+
+#define ENERGY_WIFI_UA ((ENERGY_WIFI_TX_UA * ENERGY_WIFI_TX_PERCENT + ENERGY_WIFI_RX_UA * (100 - ENERGY_WIFI_TX_PERCENT)) / 100)
+
+#define UA_US_PER_UAH 3600000000LL
+
+enum EnergyState {
+  EnergyCpu = 0,    // CPU active (current depends on the frequency)
+  EnergyWifi,       // wifi radio on
+  EnergyLcd,        // LCD on
+  EnergyPower,      // POWER_PIN high (servo powered)
+  EnergyLightSleep, // light sleep
+  EnergyDeepSleep,  // deep sleep
+  EnergyDelimiter
+};
+
+/**
+ * Figures of the last cycle, meant to be kept in RTC memory (as deep sleep resets the device).
+ */
+struct EnergyMeterData {
+  uint32_t cycleUas;  // charge of the last cycle [uA*s] (0 if unknown)
+  uint32_t cycleSecs; // duration of the last cycle (awake time plus sleep)
+};
+
+/**
+ * Energy estimator: combines a table of currents per state with the time spent in each state.
+ *
+ * A cycle is made of the awake time (states switched on / off explicitly) followed by
+ * a sleep (provided with its duration).
+ */
+class EnergyMeter {
+
+private:
+  unsigned long (*micros)();
+  int cpuMhz;
+  bool on[EnergyDelimiter];
+  unsigned long since[EnergyDelimiter];
+  int64_t charge; // current cycle charge (uA*us)
+  unsigned long awakeMs;
+  unsigned long awakeSince;
+  int64_t lastCycleCharge;  // (uA*us)
+  int64_t lastAwakeCharge;  // (uA*us)
+  long lastCycleSecs;
+  long cycles;
+  int64_t totalCharge; // (uA*us)
+  int64_t totalSecs;
+  EnergyMeterData *persisted;
+
+  long current(EnergyState s) {
+    switch (s) {
+      case EnergyCpu:
+        return (cpuMhz >= 160 ? ENERGY_CPU_160MHZ_UA : (long)ENERGY_CPU_80MHZ_UA * cpuMhz / 80);
+      case EnergyWifi:
+        return ENERGY_WIFI_UA;
+      case EnergyLcd:
+        return ENERGY_LCD_UA;
+      case EnergyPower:
+        return ENERGY_POWER_UA;
+      case EnergyLightSleep:
+        return ENERGY_LIGHT_SLEEP_UA;
+      case EnergyDeepSleep:
+        return ENERGY_DEEP_SLEEP_UA;
+      default:
+        return 0;
+    }
+  }
+
+  void account(EnergyState s, unsigned long n) {
+    charge += (int64_t)current(s) * (n - since[s]);
+    since[s] = n;
+  }
+
+public:
+  EnergyMeter() {
+    micros = NULL;
+    cpuMhz = 80;
+    for (int s = 0; s < EnergyDelimiter; s++) {
+      on[s] = false;
+      since[s] = 0;
+    }
+    charge = 0;
+    awakeMs = 0;
+    awakeSince = 0;
+    lastCycleCharge = 0;
+    lastAwakeCharge = 0;
+    lastCycleSecs = 0;
+    cycles = 0;
+    totalCharge = 0;
+    totalSecs = 0;
+    persisted = NULL;
+  }
+
+  void setup(unsigned long (*m)()) {
+    micros = m;
+    awakeSince = micros();
+    switchOn(EnergyCpu);
+  }
+
+  /**
+   * Keep the figures of the last cycle in the given block, and resume from them if any (woke from deep sleep).
+   */
+  void persist(EnergyMeterData *d) {
+    persisted = d;
+    if (cycles == 0 && persisted->cycleUas > 0) {
+      lastCycleCharge = (int64_t)persisted->cycleUas * 1000000;
+      lastCycleSecs = persisted->cycleSecs;
+    }
+  }
+
+  void setCpuMhz(int mhz) {
+    if (micros != NULL && on[EnergyCpu]) {
+      account(EnergyCpu, micros());
+    }
+    cpuMhz = mhz;
+  }
+
+  void switchOn(EnergyState s) {
+    if (micros == NULL || on[s]) {
+      return;
+    }
+    on[s] = true;
+    since[s] = micros();
+  }
+
+  void switchOff(EnergyState s) {
+    if (micros == NULL || !on[s]) {
+      return;
+    }
+    account(s, micros());
+    on[s] = false;
+  }
+
+  /**
+   * Close the current cycle, to be invoked right before sleeping (in the given state) the given amount of seconds.
+   * States switched on remain so for the next cycle.
+   */
+  void endCycle(EnergyState sleepState, long sleepSecs) {
+    if (micros == NULL) {
+      return;
+    }
+    unsigned long n = micros();
+    for (int s = 0; s < EnergyDelimiter; s++) {
+      if (on[s]) {
+        account((EnergyState)s, n);
+      }
+    }
+    awakeMs = (n - awakeSince) / 1000;
+    lastAwakeCharge = charge;
+    sleepSecs = (sleepSecs < 0 ? 0 : sleepSecs);
+    lastCycleCharge = charge + (int64_t)current(sleepState) * sleepSecs * 1000000;
+    lastCycleSecs = (awakeMs / 1000) + sleepSecs;
+    totalCharge += lastCycleCharge;
+    totalSecs += lastCycleSecs;
+    cycles++;
+    charge = 0;
+    if (persisted != NULL) {
+      int64_t uas = lastCycleCharge / 1000000;
+      persisted->cycleUas = (uas > 0xFFFFFFFFLL ? 0xFFFFFFFF : (uint32_t)uas);
+      persisted->cycleSecs = lastCycleSecs;
+    }
+  }
+
+  /**
+   * Start a new cycle (to be invoked right after waking up from a non-resetting sleep).
+   */
+  void beginCycle() {
+    if (micros == NULL) {
+      return;
+    }
+    unsigned long n = micros();
+    awakeSince = n;
+    for (int s = 0; s < EnergyDelimiter; s++) {
+      since[s] = n;
+    }
+  }
+
+  /**
+   * Estimated charge (uAh) of the last cycle (awake time plus sleep, possibly of a previous boot),
+   * or of the current awake time if no cycle is known yet.
+   */
+  int getCycleUah() {
+    if (cycles == 0 && lastCycleCharge == 0) {
+      int64_t c = charge;
+      unsigned long n = (micros == NULL ? 0 : micros());
+      for (int s = 0; s < EnergyDelimiter; s++) {
+        if (on[s]) {
+          c += (int64_t)current((EnergyState)s) * (n - since[s]);
+        }
+      }
+      return (int)(c / UA_US_PER_UAH);
+    }
+    return (int)(lastCycleCharge / UA_US_PER_UAH);
+  }
+
+  /**
+   * Estimated charge (uAh) of the awake part of the last cycle.
+   */
+  int getAwakeUah() {
+    return (int)(lastAwakeCharge / UA_US_PER_UAH);
+  }
+
+  /**
+   * Projected battery life (hours) if all cycles were like the last one (0 if unknown).
+   */
+  int getLifeHours() {
+    if (lastCycleCharge <= 0) {
+      return 0;
+    }
+    // life[h] = capacity[uAh] / average current[uA], average current = charge[uA*us] / duration[us]
+    return (int)((int64_t)BATTERY_CAPACITY_MAH * 1000 * lastCycleSecs * 1000000 / lastCycleCharge);
+  }
+
+  /**
+   * Log the estimates over all the cycles completed.
+   */
+  void report() {
+    log(CLASS_ENERGY_METER, Info, "### Energy: cycles=%ld", cycles);
+    if (cycles == 0 || totalCharge <= 0) {
+      return;
+    }
+    int64_t avgCurrent = totalCharge / (totalSecs * 1000000 + 1); // uA
+    log(CLASS_ENERGY_METER, Info, "### Energy: avg %ld uAh/cycle, avg %ld uA", (long)(totalCharge / cycles / UA_US_PER_UAH), (long)avgCurrent);
+    log(CLASS_ENERGY_METER, Info, "### Energy: projected life %ld h", (long)((int64_t)BATTERY_CAPACITY_MAH * 1000 / (avgCurrent + 1)));
+  }
+};
+
+EnergyMeter energyMeter;
+
+#endif // ENERGY_METER_INC
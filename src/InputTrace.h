@@ -0,0 +1,310 @@
+#ifndef INPUT_TRACE_INC
+#define INPUT_TRACE_INC
+
+#include <Arena.h>
+#include <log4ino/Log.h>
+#include <main4ino/Buffer.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CLASS_INPUT_TRACE "IT"
+
+#ifndef INPUT_TRACE_LINE_LENGTH
+#define INPUT_TRACE_LINE_LENGTH 512 // longest event (RTC memory and file contents included, longer ones are truncated)
+#endif // INPUT_TRACE_LINE_LENGTH
+
+#define INPUT_TRACE_MARKER "TRACE " // prefix of every event (so that they can be extracted from the device logs)
+#define INPUT_TRACE_MARKER_LENGTH 6
+
+/**
+ * Kinds of external inputs (first character of an event).
+ */
+enum InputTraceKind {
+  InputTraceClock = 'T',   // time at startup: <epoch secs>
+  InputTraceMillis = 'M',  // millis read by the clock: <ms>
+  InputTraceTimeSync = 'S', // time after the synchronization with the server: <epoch secs>
+  InputTraceRtc = 'R',     // RTC memory read: <succ> <hex bytes>
+  InputTraceVcc = 'V',     // Vcc reading: <mV>
+  InputTraceFile = 'F',    // file read: <name> <succ> <escaped content>
+  InputTraceCommand = 'C', // command (serial, telnet, standard input): <escaped command>
+  InputTraceHttp = 'H'     // http request (metadata only, the body is streamed to the module): <method> <code> <url>
+};
+
+/**
+ * Trace of the external inputs of a run, one event per line ("TRACE <kind> <payload>"), to rerun it deterministically.
+ *
+ * When recording, every input is written through the platform writer as it is read.
+ * When replaying, inputs are taken from the trace instead (in order, as long as the kind of the next event
+ * matches, the live value is used otherwise and the divergence counted). Both can be active at once.
+ * Storage comes from the arena only once set up, so it costs nothing when disabled.
+ */
+class InputTrace {
+
+private:
+  void (*writer)(const char *line);
+  bool (*reader)(char *line, int length);
+  char *event;  // line being written (recording)
+  char *next;   // line read ahead (replaying)
+  bool pending; // next line not yet consumed
+  bool busy;    // event being written (inputs read meanwhile, for instance by the writer, are not traced)
+  int length;
+  long recorded;
+  long replayed;
+  long diverged;
+
+  void begin(InputTraceKind kind) {
+    snprintf(event, INPUT_TRACE_LINE_LENGTH, INPUT_TRACE_MARKER "%c ", (char)kind);
+    length = strlen(event);
+    busy = true;
+  }
+
+  void add(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(event + length, INPUT_TRACE_LINE_LENGTH - 1 - length, format, args);
+    va_end(args);
+    length = (length + n < INPUT_TRACE_LINE_LENGTH - 1 ? length + n : INPUT_TRACE_LINE_LENGTH - 2);
+  }
+
+  void addEscaped(const char *s) {
+    for (; *s != 0 && length < INPUT_TRACE_LINE_LENGTH - 3; s++) {
+      char c = *s;
+      if (c == '\\' || c == '\n' || c == '\r') {
+        event[length++] = '\\';
+        c = (c == '\n' ? 'n' : (c == '\r' ? 'r' : c));
+      }
+      event[length++] = c;
+    }
+    event[length] = 0;
+  }
+
+  void end() {
+    if (length >= INPUT_TRACE_LINE_LENGTH - 3) {
+      log(CLASS_INPUT_TRACE, Warn, "Truncated: %c", event[INPUT_TRACE_MARKER_LENGTH]);
+    }
+    event[length++] = '\n';
+    event[length] = 0;
+    writer(event);
+    busy = false;
+    recorded++;
+  }
+
+  /**
+   * Payload of the next event if it is of the given kind (consumed), NULL otherwise
+   * (a mismatch counts as divergence unless the input is optional).
+   */
+  char *take(InputTraceKind kind, bool optional) {
+    if (!pending) {
+      pending = reader(next, INPUT_TRACE_LINE_LENGTH);
+      if (!pending) {
+        return NULL; // trace exhausted, live inputs from now on
+      }
+      char *m = strstr(next, INPUT_TRACE_MARKER);
+      if (m != NULL) {
+        memmove(next, m + INPUT_TRACE_MARKER_LENGTH, strlen(m + INPUT_TRACE_MARKER_LENGTH) + 1);
+      }
+      next[strcspn(next, "\r\n")] = 0;
+    }
+    if (next[0] != (char)kind || (next[1] != ' ' && next[1] != 0)) {
+      if (!optional) {
+        diverged++;
+        log(CLASS_INPUT_TRACE, Warn, "Diverged: '%c' expected, got '%c'", (char)kind, next[0]);
+      }
+      return NULL;
+    }
+    pending = false;
+    replayed++;
+    return (next[1] == 0 ? next + 1 : next + 2);
+  }
+
+  static void unescape(char *s) {
+    char *w = s;
+    for (; *s != 0; s++) {
+      if (*s == '\\' && *(s + 1) != 0) {
+        s++;
+        *w++ = (*s == 'n' ? '\n' : (*s == 'r' ? '\r' : *s));
+      } else {
+        *w++ = *s;
+      }
+    }
+    *w = 0;
+  }
+
+  static int hex(char c) {
+    return (c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1));
+  }
+
+public:
+  InputTrace() {
+    writer = NULL;
+    reader = NULL;
+    event = NULL;
+    next = NULL;
+    pending = false;
+    busy = false;
+    length = 0;
+    recorded = 0;
+    replayed = 0;
+    diverged = 0;
+  }
+
+  /**
+   * Record through the writer (fed with whole lines, newline included) and / or replay from the reader
+   * (that provides the next line, false when exhausted). Any can be NULL.
+   */
+  void setup(void (*w)(const char *line), bool (*r)(char *line, int length)) {
+    if (w != NULL) {
+      event = (char *)arena.allocate(INPUT_TRACE_LINE_LENGTH);
+    }
+    if (r != NULL) {
+      next = (char *)arena.allocate(INPUT_TRACE_LINE_LENGTH);
+    }
+    writer = (event != NULL ? w : NULL);
+    reader = (next != NULL ? r : NULL);
+    if (writer != w || reader != r) {
+      log(CLASS_INPUT_TRACE, Warn, "No room in arena");
+    }
+  }
+
+  bool isRecording() {
+    return writer != NULL;
+  }
+
+  bool isReplaying() {
+    return reader != NULL;
+  }
+
+  /**
+   * Numeric input (clock, Vcc, ...): the one of the trace if replaying, the live one otherwise.
+   */
+  long value(InputTraceKind kind, long live) {
+    if (busy) {
+      return live;
+    }
+    char *p = (isReplaying() ? take(kind, false) : NULL);
+    long v = (p != NULL ? atol(p) : live);
+    if (isRecording()) {
+      begin(kind);
+      add("%ld", v);
+      end();
+    }
+    return v;
+  }
+
+  /**
+   * Binary input (RTC memory, ...) read into data with the given success.
+   */
+  bool bytes(InputTraceKind kind, void *data, int size, bool succ) {
+    uint8_t *d = (uint8_t *)data;
+    char *p = (isReplaying() ? take(kind, false) : NULL);
+    if (p != NULL) {
+      succ = (*p == '1');
+      p += (*p != 0 ? 1 : 0);
+      p += (*p == ' ' ? 1 : 0);
+      for (int i = 0; i < size && hex(p[0]) >= 0 && hex(p[1]) >= 0; i++, p += 2) {
+        d[i] = (uint8_t)(hex(p[0]) * 16 + hex(p[1]));
+      }
+    }
+    if (isRecording()) {
+      begin(kind);
+      add("%d ", (int)succ);
+      for (int i = 0; i < size && succ; i++) {
+        add("%02x", d[i]);
+      }
+      end();
+    }
+    return succ;
+  }
+
+  /**
+   * File read into content with the given success.
+   */
+  bool file(const char *name, Buffer *content, bool succ) {
+    char *p = (isReplaying() ? take(InputTraceFile, false) : NULL);
+    if (p != NULL) {
+      int n = strlen(name);
+      if (strncmp(p, name, n) == 0 && p[n] == ' ') {
+        succ = (p[n + 1] == '1');
+        p += n + 2;
+        p += (*p == ' ' ? 1 : 0);
+        unescape(p);
+        content->load(p);
+      } else {
+        diverged++;
+        log(CLASS_INPUT_TRACE, Warn, "Diverged: file %s expected", name);
+      }
+    }
+    if (isRecording()) {
+      begin(InputTraceFile);
+      add("%s %d ", name, (int)succ);
+      addEscaped(succ ? content->getBuffer() : "");
+      end();
+    }
+    return succ;
+  }
+
+  void recordCommand(const char *cmd) {
+    if (isRecording()) {
+      begin(InputTraceCommand);
+      addEscaped(cmd);
+      end();
+    }
+  }
+
+  /**
+   * Load the next command of the trace into cmd (only if it is the next event), returns true if so.
+   */
+  bool replayCommand(Buffer *cmd) {
+    char *p = (isReplaying() ? take(InputTraceCommand, true) : NULL);
+    if (p == NULL) {
+      return false;
+    }
+    unescape(p);
+    cmd->load(p);
+    recordCommand(cmd->getBuffer());
+    return true;
+  }
+
+  /**
+   * Http request done (the response is not replayed, but requests are expected in the same order).
+   */
+  void http(int method, const char *url, int code) {
+    char *p = (isReplaying() ? take(InputTraceHttp, false) : NULL);
+    const char *u = (p != NULL ? strchr(p, ' ') : NULL); // skip method
+    u = (u != NULL ? strchr(u + 1, ' ') : NULL);         // skip code
+    if (p != NULL && (u == NULL || strcmp(u + 1, url) != 0)) {
+      diverged++;
+      log(CLASS_INPUT_TRACE, Warn, "Diverged: request %s", url);
+    }
+    if (isRecording()) {
+      begin(InputTraceHttp);
+      add("%d %d %s", method, code, url);
+      end();
+    }
+  }
+
+  long getRecorded() {
+    return recorded;
+  }
+
+  long getReplayed() {
+    return replayed;
+  }
+
+  long getDiverged() {
+    return diverged;
+  }
+
+  void report() {
+    if (isRecording() || isReplaying()) {
+      log(CLASS_INPUT_TRACE, Info, "### Input trace: recorded=%ld replayed=%ld diverged=%ld", recorded, replayed, diverged);
+    }
+  }
+};
+
+InputTrace inputTrace;
+
+#endif // INPUT_TRACE_INC
@@ -0,0 +1,152 @@
+#ifndef LINE_EDITOR_INC
+#define LINE_EDITOR_INC
+
+#include <string.h>
+
+#ifndef LINE_EDITOR_MAX_LENGTH
+#define LINE_EDITOR_MAX_LENGTH 128
+#endif // LINE_EDITOR_MAX_LENGTH
+
+#ifndef LINE_EDITOR_HISTORY
+#define LINE_EDITOR_HISTORY 4 // amount of lines kept in the history
+#endif // LINE_EDITOR_HISTORY
+
+#define LINE_EDITOR_ESC 0x1b
+#define LINE_EDITOR_BACKSPACE 0x08
+#define LINE_EDITOR_DELETE 0x7f
+#define LINE_EDITOR_CTRL_U 0x15
+
+enum LineEditorEscState {
+  EscNone = 0, // regular input
+  EscStart,    // ESC received
+  EscSequence  // ESC [ (or ESC O) received, waiting for the final byte
+};
+
+/**
+ * Non-blocking line editor for terminal input, fed one byte at a time.
+ *
+ * Supports backspace, line kill (ctrl-u), and history browsing with up / down arrows
+ * (ANSI escape sequences, other sequences are ignored). History is kept in a ring.
+ * Once a line is completed (enter) it stays available until consumed, input received meanwhile is ignored.
+ */
+class LineEditor {
+
+private:
+  char line[LINE_EDITOR_MAX_LENGTH + 1];
+  int length;
+  bool complete;
+  LineEditorEscState esc;
+  char history[LINE_EDITOR_HISTORY][LINE_EDITOR_MAX_LENGTH + 1];
+  int historyNewest; // slot of the newest line in the history ring
+  int historyCount;
+  int browsing; // age of the history line being shown (-1 if not browsing)
+  void (*echo)(const char *s);
+
+  void print(const char *s) {
+    if (echo != NULL) {
+      echo(s);
+    }
+  }
+
+  void recall(int age) {
+    browsing = age;
+    if (age < 0) {
+      line[0] = 0;
+    } else {
+      int slot = (historyNewest - age + LINE_EDITOR_HISTORY) % LINE_EDITOR_HISTORY;
+      strcpy(line, history[slot]);
+    }
+    length = strlen(line);
+    print("\r\x1b[K"); // redraw the line
+    print(line);
+  }
+
+  void escape(char c) {
+    if (esc == EscStart) {
+      esc = ((c == '[' || c == 'O') ? EscSequence : EscNone);
+      return;
+    }
+    if (c >= '@' && c <= '~') { // final byte of the sequence
+      esc = EscNone;
+      if (c == 'A' && browsing + 1 < historyCount) { // up
+        recall(browsing + 1);
+      } else if (c == 'B' && browsing >= 0) { // down
+        recall(browsing - 1);
+      }
+    }
+  }
+
+public:
+  LineEditor() {
+    length = 0;
+    line[0] = 0;
+    complete = false;
+    esc = EscNone;
+    historyNewest = 0;
+    historyCount = 0;
+    browsing = -1;
+    echo = NULL;
+  }
+
+  void setup(void (*e)(const char *s)) {
+    echo = e;
+  }
+
+  /**
+   * Process a received byte, returns true if a line is available.
+   */
+  bool feed(char c) {
+    if (complete) {
+      return true;
+    } else if (esc != EscNone) {
+      escape(c);
+    } else if (c == LINE_EDITOR_ESC) {
+      esc = EscStart;
+    } else if (c == '\r' || c == '\n') {
+      print("\r\n");
+      complete = (length > 0); // empty lines (for instance '\n' after '\r') are ignored
+      browsing = -1;
+    } else if (c == LINE_EDITOR_BACKSPACE || c == LINE_EDITOR_DELETE) {
+      if (length > 0) {
+        line[--length] = 0;
+        print("\b \b");
+      }
+    } else if (c == LINE_EDITOR_CTRL_U) {
+      recall(-1);
+    } else if (c >= ' ' && length < LINE_EDITOR_MAX_LENGTH) {
+      line[length++] = c;
+      line[length] = 0;
+      char s[2] = {c, 0};
+      print(s);
+    }
+    return complete;
+  }
+
+  bool hasLine() {
+    return complete;
+  }
+
+  const char *getLine() {
+    return line;
+  }
+
+  /**
+   * Release the completed line (it is added to the history), so that a new one can be edited.
+   */
+  void consume() {
+    if (!complete) {
+      return;
+    }
+    int newest = (historyCount == 0 ? historyNewest : (historyNewest + 1) % LINE_EDITOR_HISTORY);
+    if (historyCount == 0 || strcmp(history[historyNewest], line) != 0) { // skip repetitions
+      historyNewest = newest;
+      strcpy(history[historyNewest], line);
+      historyCount = (historyCount < LINE_EDITOR_HISTORY ? historyCount + 1 : historyCount);
+    }
+    length = 0;
+    line[0] = 0;
+    complete = false;
+  }
+};
+
+#endif // LINE_EDITOR_INC
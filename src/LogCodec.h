@@ -0,0 +1,152 @@
+#ifndef LOG_CODEC_INC
+#define LOG_CODEC_INC
+
+#include <LogFormats.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+/**
+ * Encoding and decoding of deferred log records.
+ *
+ * A record looks like: ~<class>,<level>,<format id>:<arg>,<arg>,...
+ * with integers in hexadecimal, floats as the hexadecimal of their IEEE-754 bits,
+ * and strings as they are (',' and '\n' replaced by ' ').
+ */
+
+#define LOG_DEFERRED_MAX_LENGTH 96
+
+// Append the hexadecimal representation of v to out (returns the amount of chars written).
+int logEncodeHex(char *out, long v) {
+  const char *digits = "0123456789abcdef";
+  char aux[2 * sizeof(long) + 1];
+  int n = 0;
+  int i = 0;
+  unsigned long u = (unsigned long)v;
+  if (v < 0) {
+    out[n++] = '-';
+    u = (unsigned long)(-v);
+  }
+  do {
+    aux[i++] = digits[u & 0xf];
+    u >>= 4;
+  } while (u != 0);
+  while (i > 0) {
+    out[n++] = aux[--i];
+  }
+  return n;
+}
+
+int logEncodeFloat(char *out, float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return logEncodeHex(out, (long)bits);
+}
+
+float logDecodeFloat(const char *in) {
+  uint32_t bits = (uint32_t)strtoul(in, NULL, 16);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/**
+ * Encode a deferred log record (no trailing newline), returns its length.
+ */
+int logEncodeRecord(char *out, int outLength, const char *clz, int level, int id, va_list args) {
+  int o = 0;
+  out[o++] = LOG_DEFERRED_MARK;
+  while (*clz != 0 && o < 8) {
+    out[o++] = *clz++;
+  }
+  out[o++] = ',';
+  o += logEncodeHex(out + o, level);
+  out[o++] = ',';
+  o += logEncodeHex(out + o, id);
+  out[o++] = ':';
+  const char *types = (id >= 0 && id < LogFmtDelimiter ? LogFormatTypes[id] : "");
+  for (int i = 0; types[i] != 0 && o < outLength - (2 * (int)sizeof(long) + 3); i++) {
+    if (i > 0) {
+      out[o++] = ',';
+    }
+    switch (types[i]) {
+      case 'd':
+        o += logEncodeHex(out + o, va_arg(args, int));
+        break;
+      case 'f':
+        o += logEncodeFloat(out + o, (float)va_arg(args, double));
+        break;
+      default: {
+        const char *str = va_arg(args, const char *);
+        while (*str != 0 && o < outLength - 1) {
+          char c = *str++;
+          out[o++] = (c == ',' || c == '\n' ? ' ' : c);
+        }
+      } break;
+    }
+  }
+  return o;
+}
+
+/**
+ * Decode a deferred log record into its text (<class> <level> <message>).
+ * Returns false if the record is not a valid deferred one.
+ */
+bool logDecodeRecord(const char *rec, char *out, int outLength) {
+  if (rec[0] != LOG_DEFERRED_MARK) {
+    return false;
+  }
+  char clz[8];
+  int level;
+  int id;
+  int n = 0;
+  if (sscanf(rec + 1, "%7[^,],%x,%x:%n", clz, &level, &id, &n) != 3 || n == 0 || id < 0 || id >= LogFmtDelimiter) {
+    return false;
+  }
+  const char *args = rec + 1 + n;
+  const char *fmt = LogFormatFormats[id];
+  const char *types = LogFormatTypes[id];
+  int o = snprintf(out, outLength, "%s %d ", clz, level);
+  while (*fmt != 0 && o < outLength - 1) {
+    if (*fmt != '%' || fmt[1] == '%') {
+      out[o++] = *fmt;
+      fmt += (*fmt == '%' ? 2 : 1);
+      continue;
+    }
+    // conversion specification: %[flags][width][.precision][length]conversion
+    char spec[16];
+    int s = 0;
+    do {
+      spec[s++] = *fmt++;
+    } while (*fmt != 0 && strchr("-+ #0123456789.lh", *fmt) != NULL && s < (int)sizeof(spec) - 2);
+    spec[s++] = *fmt;
+    spec[s] = 0;
+    fmt += (*fmt == 0 ? 0 : 1);
+    // argument
+    char arg[LOG_DEFERRED_MAX_LENGTH];
+    int a = 0;
+    while (*args != 0 && *args != ',' && *args != '\n' && a < (int)sizeof(arg) - 1) {
+      arg[a++] = *args++;
+    }
+    arg[a] = 0;
+    args += (*args == ',' ? 1 : 0);
+    switch (*types != 0 ? *types++ : 's') {
+      case 'd':
+        o += snprintf(out + o, outLength - o, spec, (int)strtol(arg, NULL, 16));
+        break;
+      case 'f':
+        o += snprintf(out + o, outLength - o, spec, (double)logDecodeFloat(arg));
+        break;
+      default:
+        o += snprintf(out + o, outLength - o, spec, arg);
+        break;
+    }
+  }
+  o = (o < outLength ? o : outLength - 1);
+  out[o] = 0;
+  return true;
+}
+
+#endif // LOG_CODEC_INC
@@ -0,0 +1,54 @@
+#ifndef LOG_FORMATS_INC
+#define LOG_FORMATS_INC
+
+/**
+ * Table of formats of the log lines of the hot paths, shared between the firmware and the host decoder.
+ *
+ * With LOG_DEFERRED_ENABLED such lines are not formatted on the device: a record with the format id
+ * and the raw arguments is kept instead (see logDeferred), and the host decoder rebuilds the text.
+ * Entries must only be appended (ids of already released firmwares must be kept): entries no longer
+ * used are retired (R) instead of removed, so that only the host decoder keeps their format.
+ *
+ * Argument types: 'd' integer, 'f' float, 's' string.
+ */
+#define LOG_FORMATS(F, R)                                                                                                                  \
+  R(LogFmtRetiredBatteryVcc, "Vcc: %0.3f", "f") /* replaced by LogFmtBatteryVccMv */                                                       \
+  F(LogFmtBatteryRange, "[mvmin=%d <= mvnow=%d <= mvmax=%d]", "ddd")                                                                       \
+  F(LogFmtBatteryEnergy, "[cycle=%duAh life=%dh]", "dd")                                                                                  \
+  F(LogFmtServonRotate, "rotate(%d)", "d")                                                                                                 \
+  F(LogFmtPlatformMessage, "Msg(%d,%d):%s", "dds")                                                                                        \
+  F(LogFmtBatteryVccMv, "Vcc: %dmV", "d")
+
+#define LOG_FORMAT_ID(id, fmt, types) id,
+#define LOG_FORMAT_FMT(id, fmt, types) fmt,
+#define LOG_FORMAT_TYPES(id, fmt, types) types,
+
+#ifdef LOG_FORMATS_DECODER
+#define LOG_FORMAT_RETIRED_FMT(id, fmt, types) fmt,
+#define LOG_FORMAT_RETIRED_TYPES(id, fmt, types) types,
+#else // LOG_FORMATS_DECODER
+#define LOG_FORMAT_RETIRED_FMT(id, fmt, types) "", // not logged by the firmware anymore
+#define LOG_FORMAT_RETIRED_TYPES(id, fmt, types) "",
+#endif // LOG_FORMATS_DECODER
+
+enum LogFormatId { LOG_FORMATS(LOG_FORMAT_ID, LOG_FORMAT_ID) LogFmtDelimiter };
+
+const char *LogFormatFormats[LogFmtDelimiter] = {LOG_FORMATS(LOG_FORMAT_FMT, LOG_FORMAT_RETIRED_FMT)};
+const char *LogFormatTypes[LogFmtDelimiter] = {LOG_FORMATS(LOG_FORMAT_TYPES, LOG_FORMAT_RETIRED_TYPES)};
+
+#define LOG_DEFERRED_MARK '~'
+
+#ifdef LOG_DEFERRED_ENABLED
+
+// Record a log line with no formatting (to be provided by the platform).
+void logDeferred(const char *clz, int level, int id, ...);
+
+#define logFmt(clz, level, id, ...) logDeferred(clz, level, id, __VA_ARGS__)
+
+#else // LOG_DEFERRED_ENABLED
+
+#define logFmt(clz, level, id, ...) log(clz, level, LogFormatFormats[id], __VA_ARGS__)
+
+#endif // LOG_DEFERRED_ENABLED
+
+#endif // LOG_FORMATS_INC
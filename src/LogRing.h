@@ -0,0 +1,138 @@
+#ifndef LOG_RING_INC
+#define LOG_RING_INC
+
+#include <string.h>
+
+/**
+ * Fixed-capacity ring of log records (lines terminated by '\n') written over an external storage.
+ *
+ * When full, the oldest records are overwritten so that the newest (most relevant) ones survive.
+ * Content can be read with no copy (once linearized in place) as a single null-terminated string.
+ */
+class LogRing {
+
+private:
+  char *data;
+  int capacity; // usable bytes (one byte of the storage is kept for the null termination)
+  int head;     // position of the oldest byte
+  int used;
+  long dropped; // amount of records overwritten
+
+  void reverse(int from, int to) { // reverse data[from, to)
+    for (to--; from < to; from++, to--) {
+      char c = data[from];
+      data[from] = data[to];
+      data[to] = c;
+    }
+  }
+
+  void dropOldest() {
+    int i = 0;
+    while (i < used && data[(head + i) % capacity] != '\n') {
+      i++;
+    }
+    i = (i < used ? i + 1 : used);
+    head = (head + i) % capacity;
+    used -= i;
+    dropped++;
+  }
+
+  void terminate() { // keep the content null-terminated whenever it is linear (spare byte at data[capacity])
+    int end = head + used;
+    if (end <= capacity || used < capacity) {
+      data[end > capacity ? end - capacity : end] = 0;
+    }
+  }
+
+public:
+  LogRing() {
+    data = NULL;
+    capacity = 0;
+    head = 0;
+    used = 0;
+    dropped = 0;
+  }
+
+  void setup(char *storage, int storageLength) {
+    data = storage;
+    capacity = storageLength - 1;
+    head = 0;
+    used = 0;
+    data[0] = 0;
+  }
+
+  /**
+   * Append n bytes to the ring (a record is complete once a '\n' is written).
+   */
+  void write(const char *s, int n) {
+    if (data == NULL || n <= 0) {
+      return;
+    }
+    if (n > capacity) { // keep only the tail
+      s += n - capacity;
+      n = capacity;
+    }
+    while (used + n > capacity) {
+      dropOldest();
+    }
+    int tail = (head + used) % capacity;
+    int first = (n < capacity - tail ? n : capacity - tail);
+    memcpy(data + tail, s, first);
+    memcpy(data, s + first, n - first);
+    used += n;
+    terminate();
+  }
+
+  /**
+   * Rotate the content in place so that it starts at the beginning of the storage and is null-terminated.
+   */
+  void linearize() {
+    if (data == NULL) {
+      return;
+    }
+    if (head != 0) {
+      reverse(0, head);
+      reverse(head, capacity);
+      reverse(0, capacity);
+      head = 0;
+    }
+    data[used] = 0;
+  }
+
+  /**
+   * Adopt the null-terminated content written straight into the storage.
+   */
+  void reload() {
+    if (data == NULL) {
+      return;
+    }
+    head = 0;
+    used = strnlen(data, capacity);
+    terminate();
+  }
+
+  /**
+   * Empty the ring (for instance once its content has been uploaded).
+   */
+  void clear() {
+    if (data == NULL) {
+      return;
+    }
+    head = 0;
+    used = 0;
+    data[0] = 0;
+  }
+
+  int getUsed() {
+    return used;
+  }
+
+  /**
+   * Amount of records overwritten since boot (published in the status).
+   */
+  long getDropped() {
+    return dropped;
+  }
+};
+
+#endif // LOG_RING_INC
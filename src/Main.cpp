@@ -9,6 +9,8 @@
 
 #define CLASS_MAIN "MA"
 
+#define LOGS_URL_SUFFIX "/logs" // main4ino endpoint receiving the logs of the device
+
 //////////////////////////////////////////////////////////////
 // Provided by generic Main
 //////////////////////////////////////////////////////////////
@@ -17,24 +19,49 @@
 
 
 HttpResponse httpMethodCustom(HttpMethod m, const char *url, Stream *body, Table *headers, const char *fingerprint) {
+  ALLOC_SCOPE(AllocSync);
   heartbeat();
-  return httpMethod(m, url, body, headers, fingerprint);
+  phaseTimer.begin(PhaseSync);
+  HttpResponse r = httpMethod(m, url, body, headers, fingerprint);
+  phaseTimer.end(PhaseSync);
+  inputTrace.http((int)m, url, r.code);
+  if (r.code < 0) { // connection failed, the cached lease may be stale: next connection uses DHCP
+    rtcState.getData()->wifi.ssid = 0;
+  }
+  if (r.code >= 200 && r.code < 300 && strstr(url, LOGS_URL_SUFFIX) != NULL) { // logs uploaded, the uploader clears the buffer next
+    logRing.clear();
+  }
+  return r;
 }
 
 void setup() {
+  ALLOC_SCOPE(AllocSetup);
+  phaseTimer.setup(microsArchitecture);
+  energyMeter.setup(microsArchitecture);
+  tuningStore.setup(readFile, writeFile);
+  servoMotion.setup(microsArchitecture, SERVO_SETTLE_MIN_MS, SERVO_SETTLE_MS_PER_DEGREE);
+
+  phaseTimer.begin(PhaseSetupArchitecture);
   setupArchitecture();
+  phaseTimer.end(PhaseSetupArchitecture);
+  setTimeCustom(InputTraceClock);
+  vccSamples.setup(&rtcState.getData()->vccs, now);
+  energyMeter.persist(&rtcState.getData()->energy);
+  phaseTimer.persist(&rtcState.getData()->phases);
 
   log(CLASS_MAIN, Info, "Resume DS...");
+  phaseTimer.begin(PhaseResumeDeepSleep);
   resumeExtendedDeepSleepIfApplicable();
+  phaseTimer.end(PhaseResumeDeepSleep);
 
-  m = new ModuleSleepino();
+  m = arena.make<ModuleSleepino>();
   m->setup(messageFunc,
            initWifiSimple,
-           stopWifi,
+           stopWifiSimple,
            httpMethodCustom,
            clearDevice,
-           readFile,
-           writeFile,
+           readFileCustom,
+           writeFileCustom,
            sleepInterruptable,
            deepSleepNotInterruptableCustom,
            configureModeArchitecture,
@@ -47,22 +74,33 @@ void setup() {
            apiDevicePass,
            commandFunc,
            getLogBuffer,
-           vcc,
+           vccMillivoltsCustom,
            servo,
            io
   );
 
   log(CLASS_MAIN, Info, "Startup properties...");
+  phaseTimer.begin(PhaseStartupProperties);
   StartupStatus s = m->startupProperties();
+  phaseTimer.end(PhaseStartupProperties);
+  setTimeCustom(InputTraceTimeSync); // time possibly set from the server response
+  rtcState.getData()->syncTime = now();
+  rtcState.getData()->syncCode = s.startupCode;
   m->getBot()->setMode(s.botMode);
   if (s.startupCode != ModuleStartupPropertiesCodeSuccess && s.startupCode != ModuleStartupPropertiesCodeSkipped) {
     log(CLASS_MAIN, Error, "Failed: %d", (int)s.startupCode);
     abort("Cannot startup properties");
   }
+  log(CLASS_MAIN, Info, "Arena: %d/%d", (int)arena.getUsed(), (int)arena.getSize());
   log(CLASS_MAIN, Info, "Setup done.");
 }
 
 void loop() {
+  ALLOC_SCOPE(AllocLoop);
+  phaseTimer.begin(PhaseLoop);
   m->loop();
+  servoMotion.tick();
+  displayFlush();
+  phaseTimer.end(PhaseLoop);
 }
 
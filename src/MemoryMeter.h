@@ -0,0 +1,138 @@
+#ifndef MEMORY_METER_INC
+#define MEMORY_METER_INC
+
+#include <log4ino/Log.h>
+#include <main4ino/Buffer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CLASS_MEMORY_METER "MM"
+
+#define MEMORY_BUFFER_SIZE 48
+
+#ifndef MEMORY_STACK_PAINT_BYTES
+#define MEMORY_STACK_PAINT_BYTES 8192 // depth of stack painted (only where the platform does not provide it)
+#endif // MEMORY_STACK_PAINT_BYTES
+
+#define MEMORY_STACK_PATTERN 0xA5
+#define MEMORY_UNKNOWN 0xFFFFFFFF
+
+uintptr_t memoryStackRegion = 0; // lowest address of the painted region
+
+/**
+ * Paint the stack below the caller with a known pattern (to measure later how deep it got used).
+ *
+ * Meant for platforms with no native stack high-water mark, to be invoked once, as early as possible.
+ */
+__attribute__((noinline)) void memoryStackPaint() {
+  volatile uint8_t region[MEMORY_STACK_PAINT_BYTES];
+  for (int i = 0; i < MEMORY_STACK_PAINT_BYTES; i++) {
+    region[i] = MEMORY_STACK_PATTERN;
+  }
+  memoryStackRegion = (uintptr_t)region; // remains valid stack memory (below the caller)
+}
+
+/**
+ * Bytes of the painted region never used since painting (as the stack grows downwards, from the lowest address).
+ */
+uint32_t memoryStackUnused() {
+  if (memoryStackRegion == 0) {
+    return MEMORY_UNKNOWN;
+  }
+  volatile uint8_t *region = (volatile uint8_t *)memoryStackRegion;
+  uint32_t i = 0;
+  while (i < MEMORY_STACK_PAINT_BYTES && region[i] == MEMORY_STACK_PATTERN) {
+    i++;
+  }
+  return i;
+}
+
+/**
+ * Memory telemetry of a wake cycle: minimum free heap, minimum largest free block (fragmentation)
+ * and minimum free stack (high-water mark).
+ *
+ * Figures come from probes provided by the platform (any can be NULL), which must not allocate.
+ * Sampling is cheap and allocation free, so it can be done often (heartbeat, loop).
+ */
+class MemoryMeter {
+
+private:
+  uint32_t (*freeHeap)();
+  uint32_t (*maxBlock)();
+  uint32_t (*freeStack)();
+  uint32_t minFreeHeap;
+  uint32_t minMaxBlock;
+  uint32_t minFreeStack;
+
+  static void probe(uint32_t (*p)(), uint32_t *min) {
+    if (p != NULL) {
+      uint32_t v = p();
+      *min = (v < *min ? v : *min);
+    }
+  }
+
+public:
+  MemoryMeter() {
+    freeHeap = NULL;
+    maxBlock = NULL;
+    freeStack = NULL;
+    beginCycle();
+  }
+
+  void setup(uint32_t (*heap)(), uint32_t (*block)(), uint32_t (*stack)()) {
+    freeHeap = heap;
+    maxBlock = block;
+    freeStack = stack;
+    sample();
+  }
+
+  void sample() {
+    probe(freeHeap, &minFreeHeap);
+    probe(maxBlock, &minMaxBlock);
+    probe(freeStack, &minFreeStack);
+  }
+
+  /**
+   * Start a new cycle (to be invoked right after waking up from a non-resetting sleep).
+   */
+  void beginCycle() {
+    minFreeHeap = MEMORY_UNKNOWN;
+    minMaxBlock = MEMORY_UNKNOWN;
+    minFreeStack = MEMORY_UNKNOWN;
+  }
+
+  uint32_t getMinFreeHeap() {
+    return minFreeHeap;
+  }
+
+  uint32_t getMinMaxBlock() {
+    return minMaxBlock;
+  }
+
+  uint32_t getMinFreeStack() {
+    return minFreeStack;
+  }
+
+  /**
+   * Write the summary (as "heap:B blk:B stk:B", unknown figures as -1) into the buffer if it differs
+   * from its content, returns true if so.
+   */
+  bool summary(Buffer *b) {
+    char s[MEMORY_BUFFER_SIZE];
+    snprintf(s, sizeof(s), "heap:%ld blk:%ld stk:%ld", figure(minFreeHeap), figure(minMaxBlock), figure(minFreeStack));
+    if (b->equals(s)) {
+      return false;
+    }
+    b->load(s);
+    return true;
+  }
+
+  static long figure(uint32_t v) {
+    return (v == MEMORY_UNKNOWN ? -1L : (long)v);
+  }
+};
+
+MemoryMeter memoryMeter;
+
+#endif // MEMORY_METER_INC
@@ -2,7 +2,15 @@
 #define MODULE_SLEEPINO_INC
 
 #include <Pinout.h>
+#include <AllocCounter.h>
+#include <Arena.h>
+#include <Command.h>
 #include <Constants.h>
+#include <EnergyMeter.h>
+#include <LogFormats.h>
+#include <MemoryMeter.h>
+#include <PhaseTimer.h>
+#include <Scheduler.h>
 #include <log4ino/Log.h>
 #include <main4ino/Actor.h>
 
@@ -15,6 +23,8 @@
 
 #define COMMAND_MAX_LENGTH 128
 
+#define MODULE_DIRTY_ACTORS 3 // actors whose changed props are tracked (settings, battery, servon)
+
 #define HELP_COMMAND_CLI_PROJECT                                                                                                           \
   "\n  SLEEPINO HELP"                                                                                                                      \
   "\n  lcd ...         : write on display <x> <y> <color> <wrap> <clear> <size> <str>"                                                     \
@@ -38,44 +48,91 @@ private:
   Battery *battery;
   Servon *servon;
 
+  long publishedCycles;
+  uint32_t reportedDirty[MODULE_DIRTY_ACTORS]; // masks of dirty props last logged
+
   void (*message)(int x, int y, int color, bool wrap, MsgClearMode clear, int size, const char *str);
   void (*commandFunc)(const char *str);
-  void (*servo)(int idx, int pos);
   void (*io)(int pin, int level);
 
-  std::function<void (int)> rotate = [&](int d) { 
-    if (servo != NULL) {
-      log(CLASS_SERVON, Debug, "rotate(%d)", d);
-      servo(0, d);
-    }
-  };
-
   std::function<void (bool)> enable = [&](bool e) { 
     if (io != NULL) {
       if (e) {
         log(CLASS_SERVON, Debug, "Enabled.");
         io(POWER_PIN, HIGH);
+        energyMeter.switchOn(EnergyPower);
       } else {
         log(CLASS_SERVON, Debug, "Disabled.");
         io(POWER_PIN, LOW);
+        energyMeter.switchOff(EnergyPower);
       }
     }
   };
 
+  CmdExecStatus commandLcd(CommandArgs *args) {
+    int x, y, color, wrap, clear, size;
+    if (!args->nextInt(&x) || !args->nextInt(&y) || !args->nextInt(&color) || !args->nextInt(&wrap) || !args->nextInt(&clear) ||
+        !args->nextInt(&size) || args->rest() == NULL) {
+      logRaw(CLASS_MODULEB, Warn, "Arguments needed:\n  lcd <x> <y> <color> <wrap> <clear> <size> <str>");
+      return InvalidArgs;
+    }
+    const char *str = args->rest();
+    log(CLASS_MODULEB, User, "-> Lcd %s", str);
+    message(x, y, color, wrap, (MsgClearMode)clear, size, str);
+    return Executed;
+  }
+
+  CmdExecStatus commandServo(CommandArgs *args) {
+    int idx, pos;
+    if (!args->nextInt(&idx) || !args->nextInt(&pos)) {
+      logRaw(CLASS_MODULEB, Warn, "Arguments needed:\n  servo <idx> <pos>");
+      return InvalidArgs;
+    }
+    log(CLASS_MODULEB, User, "-> Servo %d %d", idx, pos);
+    servoMotion.move(idx, pos);
+    return Executed;
+  }
+
+  CmdExecStatus commandIo(CommandArgs *args) {
+    int pin, out;
+    if (!args->nextInt(&pin) || !args->nextInt(&out)) {
+      logRaw(CLASS_MODULEB, Warn, "Arguments needed:\n  io <pin> <out>");
+      return InvalidArgs;
+    }
+    log(CLASS_MODULEB, User, "-> Io %d %d", pin, out);
+    io(pin, out);
+    return Executed;
+  }
+
+  PropDirty *dirtyProps(int i) {
+    switch (i) {
+      case 0:
+        return bsettings->getDirtyProps();
+      case 1:
+        return battery->getDirtyProps();
+      default:
+        return servon->getDirtyProps();
+    }
+  }
+
 public:
   ModuleSleepino() {
 
-    module = new Module();
+    module = arena.make<Module>();
 
-    bsettings = new SleepinoSettings("sleepino");
-    battery = new Battery("battery");
-    servon = new Servon("servon");
+    bsettings = arena.make<SleepinoSettings>("sleepino");
+    battery = arena.make<Battery>("battery");
+    servon = arena.make<Servon>("servon");
 
     module->getActors()->add(3, (Actor *)bsettings, (Actor *)battery, (Actor *)servon);
 
+    publishedCycles = -1;
+    for (int i = 0; i < MODULE_DIRTY_ACTORS; i++) {
+      reportedDirty[i] = 0;
+    }
+
     message = NULL;
     commandFunc = NULL;
-    servo = NULL;
     io = NULL;
   }
 
@@ -99,16 +156,15 @@ public:
              const char *(*apiDevicePassFunc)(),
              void (*cmdFunc)(const char*),
              Buffer *(*getLogBufferFunc)(),
-             float (*vcc)(),
+             int (*vccMillivolts)(),
              void (*servoFunc)(int, int),
              void (*ioFunc)(int, int)
   ) {
     message = messageFunc;
     commandFunc = cmdFunc;
-    servo = servoFunc;
     io = ioFunc;
     bsettings->setup(commandFunc);
-    battery->setup(vcc);
+    battery->setup(vccMillivolts, &energyMeter, &vccSamples);
 
     module->setup(PROJECT_ID,
                   PLATFORM_ID,
@@ -131,7 +187,8 @@ public:
                   alwaysTrue,
                   getLogBufferFunc);
 
-    servon->setup(rotate, enable);
+    servoMotion.setActuators(servoFunc, enable);
+    servon->setup(&servoMotion);
 
   }
 
@@ -145,6 +202,10 @@ public:
     module->getPropSync()->setPropValue(PropSyncFreqProp, &never);
     module->getPropSync()->setPropValue(PropSyncForceSyncFreqProp, &never);
 
+    if (c.startupCode == ModuleStartupPropertiesCodeSuccess) {
+      synced();
+    }
+
     return c;
 
   }
@@ -153,57 +214,40 @@ public:
    * Handle a user command.
    */
   CmdExecStatus command(const char *cmd) {
+    ALLOC_SCOPE(AllocCommand);
+    log(CLASS_MODULEB, Debug, "\n> %s\n", cmd);
 
-    {
-      Buffer b(cmd);
-      log(CLASS_MODULEB, Debug, "\n> %s\n", b.getBuffer());
-
-      if (b.getLength() == 0) {
-        return NotFound;
-      }
+    CommandArgs args(cmd);
+    const char *c = args.next();
+    if (c == NULL) {
+      return NotFound;
+    }
 
-      char *c = strtok(b.getUnsafeBuffer(), " ");
-
-      if (strcmp("lcd", c) == 0) {
-        const char *x = strtok(NULL, " ");
-        const char *y = strtok(NULL, " ");
-        const char *color = strtok(NULL, " ");
-        const char *wrap = strtok(NULL, " ");
-        const char *clear = strtok(NULL, " ");
-        const char *size = strtok(NULL, " ");
-        const char *str = strtok(NULL, " ");
-        if (x == NULL || y == NULL || color == NULL || wrap == NULL || clear == NULL || size == NULL || str == NULL) {
-          logRaw(CLASS_MODULEB, Warn, "Arguments needed:\n  lcd <x> <y> <color> <wrap> <clear> <size> <str>");
-          return InvalidArgs;
+    switch (commandHash(c)) {
+      case commandHash("lcd"):
+        if (commandIs(c, "lcd")) {
+          return commandLcd(&args);
         }
-        log(CLASS_MODULEB, User, "-> Lcd %s", str);
-        message(atoi(x), atoi(y), atoi(color), atoi(wrap), (MsgClearMode)atoi(clear), atoi(size), str);
-        return Executed;
-      } else if (strcmp("servo", c) == 0) {
-        const char *sidx = strtok(NULL, " ");
-        const char *pos = strtok(NULL, " ");
-        if (sidx == NULL || pos == NULL) {
-          logRaw(CLASS_MODULEB, Warn, "Arguments needed:\n  servo <idx> <pos>");
-          return InvalidArgs;
+        break;
+      case commandHash("servo"):
+        if (commandIs(c, "servo")) {
+          return commandServo(&args);
         }
-        log(CLASS_MODULEB, User, "-> Servo %s %s", sidx, pos);
-        servo(atoi(sidx), atoi(pos));
-        return Executed;
-      } else if (strcmp("io", c) == 0) {
-        const char *pin = strtok(NULL, " ");
-        const char *out = strtok(NULL, " ");
-        if (pin == NULL || out == NULL) {
-          logRaw(CLASS_MODULEB, Warn, "Arguments needed:\n  io <pin> <out>");
-          return InvalidArgs;
+        break;
+      case commandHash("io"):
+        if (commandIs(c, "io")) {
+          return commandIo(&args);
         }
-        log(CLASS_MODULEB, User, "-> Io %s %s", pin, out);
-        io(atoi(pin), atoi(out));
-        return Executed;
-      } else if (strcmp("help", c) == 0 || strcmp("?", c) == 0) {
-        logRaw(CLASS_MODULEB, User, HELP_COMMAND_CLI_PROJECT);
-        return module->command("?");
-      }
-      // deallocate buffer memory
+        break;
+      case commandHash("help"):
+      case commandHash("?"):
+        if (commandIs(c, "help") || commandIs(c, "?")) {
+          logRaw(CLASS_MODULEB, User, HELP_COMMAND_CLI_PROJECT);
+          return module->command("?");
+        }
+        break;
+      default:
+        break;
     }
     // if none of the above went through
     return module->command(cmd);
@@ -225,6 +269,14 @@ public:
     return bsettings;
   }
 
+  Battery *getBattery() {
+    return battery;
+  }
+
+  Servon *getServon() {
+    return servon;
+  }
+
   Module *getModule() {
     return module;
   }
@@ -237,8 +289,70 @@ public:
     return module->getBot()->getClock();
   }
 
+  /**
+   * Seconds until the earliest actor is due (SCHEDULER_NEVER if none, SCHEDULER_UNKNOWN if not computable).
+   */
+  long secsToNextDue(time_t time) {
+    Array<Actor *> *actors = module->getActors();
+    scheduler.reset();
+    for (int i = 0; i < actors->size(); i++) {
+      scheduler.consider(actors->get(i)->getMetadata()->getTiming(), time);
+    }
+    return scheduler.getNext();
+  }
+
+  /**
+   * Whether any actor is due now.
+   */
+  bool anyDue() {
+    Array<Actor *> *actors = module->getActors();
+    for (int i = 0; i < actors->size(); i++) {
+      if (actors->get(i)->getMetadata()->getTiming()->matches()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Log the props changed since the last successful synchronization (whenever they differ from the ones last logged).
+   */
+  void reportDirtyProps() {
+    bool changed = false;
+    for (int i = 0; i < MODULE_DIRTY_ACTORS; i++) {
+      changed = changed || dirtyProps(i)->getMask() != reportedDirty[i];
+      reportedDirty[i] = dirtyProps(i)->getMask();
+    }
+    if (changed) {
+      log(CLASS_MODULEB, Debug, "Dirty: 0x%lx 0x%lx 0x%lx", (unsigned long)reportedDirty[0], (unsigned long)reportedDirty[1], (unsigned long)reportedDirty[2]);
+    }
+  }
+
+  /**
+   * Properties synchronization succeeded, changed props are known to the server.
+   */
+  void synced() {
+    battery->synced();
+    for (int i = 0; i < MODULE_DIRTY_ACTORS; i++) {
+      dirtyProps(i)->clear();
+    }
+  }
+
   void loop() {
+    scheduler.woke(anyDue());
+    if (publishedCycles != phaseTimer.getCompletedCycles()) { // new wake cycle timings (possibly from before deep sleep)
+      publishedCycles = phaseTimer.getCompletedCycles();
+      if (phaseTimer.summary(bsettings->getPhases())) {
+        bsettings->changedProp(SleepinoSettingsPhasesProp);
+      }
+    }
+    memoryMeter.sample();
+    if (memoryMeter.summary(bsettings->getMemory())) {
+      log(CLASS_MODULEB, Debug, "Mem: %s", bsettings->getMemory()->getBuffer());
+      bsettings->changedProp(SleepinoSettingsMemoryProp);
+    }
     module->loop();
+    reportDirtyProps();
   }
 };
 
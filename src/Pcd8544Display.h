@@ -0,0 +1,104 @@
+#ifndef PCD8544_DISPLAY_INC
+#define PCD8544_DISPLAY_INC
+
+#include <Adafruit_GFX.h>
+#include <Adafruit_PCD8544.h>
+
+#define PCD8544_BANKS (LCDHEIGHT / 8)
+#define PCD8544_CLEAN 0xFF // no dirty column in the bank
+
+/**
+ * PCD8544 display that keeps track of the regions changed since the last flush
+ * (per bank, a range of dirty columns), and pushes only those to the controller.
+ *
+ * Drawing only updates the framebuffer in RAM, the controller is updated upon flush.
+ */
+class Pcd8544Display : public Adafruit_PCD8544 {
+
+private:
+  uint8_t dirtyFrom[PCD8544_BANKS];
+  uint8_t dirtyTo[PCD8544_BANKS];
+
+  void markDirty(int x, int bank) {
+    if (dirtyFrom[bank] == PCD8544_CLEAN || x < dirtyFrom[bank]) {
+      dirtyFrom[bank] = x;
+    }
+    if (dirtyTo[bank] == PCD8544_CLEAN || x > dirtyTo[bank]) {
+      dirtyTo[bank] = x;
+    }
+  }
+
+  void markAllDirty() {
+    for (int b = 0; b < PCD8544_BANKS; b++) {
+      dirtyFrom[b] = 0;
+      dirtyTo[b] = LCDWIDTH - 1;
+    }
+  }
+
+  void markClean() {
+    for (int b = 0; b < PCD8544_BANKS; b++) {
+      dirtyFrom[b] = PCD8544_CLEAN;
+      dirtyTo[b] = PCD8544_CLEAN;
+    }
+  }
+
+  uint8_t column(int x, int bank) { // byte of the framebuffer (8 vertical pixels, LSB on top)
+    uint8_t c = 0;
+    for (int i = 0; i < 8; i++) {
+      c |= (getPixel(x, bank * 8 + i) ? 1 : 0) << i;
+    }
+    return c;
+  }
+
+public:
+  Pcd8544Display(int8_t sclk, int8_t din, int8_t dc, int8_t cs, int8_t rst) : Adafruit_PCD8544(sclk, din, dc, cs, rst) {
+    markAllDirty(); // content of the controller unknown
+  }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) {
+    Adafruit_PCD8544::drawPixel(x, y, color);
+    if (getRotation() != 0) { // coordinates not physical, keep it simple
+      markAllDirty();
+    } else if (x >= 0 && x < LCDWIDTH && y >= 0 && y < LCDHEIGHT) {
+      markDirty(x, y / 8);
+    }
+  }
+
+  void clearDisplay() {
+    Adafruit_PCD8544::clearDisplay();
+    markAllDirty();
+  }
+
+  /**
+   * Push the changed regions to the controller, returns true if anything was pushed.
+   */
+  bool flush() {
+    bool pushed = false;
+    for (int b = 0; b < PCD8544_BANKS; b++) {
+      if (dirtyFrom[b] == PCD8544_CLEAN) {
+        continue;
+      }
+      command(PCD8544_SETYADDR | b);
+      command(PCD8544_SETXADDR | dirtyFrom[b]);
+      for (int x = dirtyFrom[b]; x <= dirtyTo[b]; x++) { // address auto-increments
+        data(column(x, b));
+      }
+      pushed = true;
+    }
+    if (pushed) {
+      command(PCD8544_SETYADDR); // as display() does, prevents drifting
+    }
+    markClean();
+    return pushed;
+  }
+
+  /**
+   * Push the whole framebuffer.
+   */
+  void display() {
+    markAllDirty();
+    flush();
+  }
+};
+
+#endif // PCD8544_DISPLAY_INC
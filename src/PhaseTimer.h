@@ -0,0 +1,234 @@
+#ifndef PHASE_TIMER_INC
+#define PHASE_TIMER_INC
+
+#include <log4ino/Log.h>
+#include <main4ino/Buffer.h>
+#include <stdint.h>
+
+#define CLASS_PHASE_TIMER "PT"
+
+#ifndef PHASE_TIMER_CYCLES
+#define PHASE_TIMER_CYCLES 4 // amount of wake cycles kept in RAM
+#endif // PHASE_TIMER_CYCLES
+
+#define PHASE_TIMER_MAX_DEPTH 4
+#define PHASES_BUFFER_SIZE 96
+
+/**
+ * Stages of a wake cycle (from boot / wake up to the next sleep).
+ * Phases can be nested (for instance LCD setup happens within the architecture setup),
+ * time is accounted exclusively: a phase does not include the time of its nested phases.
+ */
+enum Phase {
+  PhaseSetupArchitecture = 0, // architecture setup (serial, pins, wifi, http, ...)
+  PhaseResumeDeepSleep,       // resume extended deep sleep if applicable
+  PhaseStartup,               // startup (failures report, restore, ...)
+  PhaseLcd,                   // LCD initialization
+  PhaseStartupProperties,     // properties load and startup synchronization
+  PhaseWifi,                  // wifi initialization
+  PhaseSync,                  // http requests (properties synchronization, logs, ...)
+  PhaseAct,                   // actors act
+  PhaseLoop,                  // rest of the module loop
+  PhaseDelimiter
+};
+
+const char *PhaseNames[PhaseDelimiter] = {"sa", "rd", "st", "lc", "sp", "wi", "sy", "ac", "lo"};
+
+/**
+ * Phases of the last closed cycle, kept across deep sleep (see RtcState).
+ */
+struct PhaseTimerData {
+  uint32_t cycleMs[PhaseDelimiter + 1]; // per phase, plus total of the cycle (total 0 if no cycle closed)
+};
+
+/**
+ * Lightweight timer of the phases of wake cycles (microseconds resolution).
+ *
+ * Keeps the last PHASE_TIMER_CYCLES cycles, a cycle being closed right before going to sleep.
+ * The last closed cycle can also be kept in a persistent block, to be published after a deep sleep.
+ */
+class PhaseTimer {
+
+private:
+  unsigned long (*micros)();
+  unsigned long cycleStart;
+  unsigned long cycles[PHASE_TIMER_CYCLES][PhaseDelimiter + 1]; // per phase, plus total of the cycle
+  unsigned long current[PhaseDelimiter + 1];
+  int stack[PHASE_TIMER_MAX_DEPTH];
+  unsigned long stackStart;
+  int depth;
+  long completed; // amount of cycles completed since boot
+  long entries[PhaseDelimiter]; // amount of times each phase was entered since boot
+  unsigned long long awakeUs; // duration of all the cycles completed since boot
+  PhaseTimerData *persisted;
+
+  void accountTop(unsigned long n) {
+    if (depth > 0) {
+      current[stack[depth - 1]] += n - stackStart;
+    }
+    stackStart = n;
+  }
+
+  void appendMs(Buffer *b, unsigned long ms) {
+    char aux[21];
+    snprintf(aux, sizeof(aux), "%lu", ms);
+    b->append(aux);
+  }
+
+  // Duration (ms) of a phase (or the total) of the last closed cycle.
+  unsigned long lastCycleMs(int p) {
+    if (completed == 0) {
+      return persisted->cycleMs[p];
+    }
+    return cycles[(completed - 1) % PHASE_TIMER_CYCLES][p] / 1000;
+  }
+
+public:
+  PhaseTimer() {
+    micros = NULL;
+    cycleStart = 0;
+    stackStart = 0;
+    depth = 0;
+    completed = 0;
+    for (int c = 0; c < PHASE_TIMER_CYCLES; c++) {
+      for (int p = 0; p <= PhaseDelimiter; p++) {
+        cycles[c][p] = 0;
+      }
+    }
+    for (int p = 0; p <= PhaseDelimiter; p++) {
+      current[p] = 0;
+    }
+    for (int p = 0; p < PhaseDelimiter; p++) {
+      entries[p] = 0;
+    }
+    awakeUs = 0;
+    persisted = NULL;
+  }
+
+  void setup(unsigned long (*m)()) {
+    micros = m;
+    cycleStart = micros();
+    stackStart = cycleStart;
+  }
+
+  /**
+   * Keep the last closed cycle in the given block (the one there is the last closed cycle until one is closed).
+   */
+  void persist(PhaseTimerData *d) {
+    persisted = d;
+  }
+
+  /**
+   * Start timing a phase (the currently running phase if any is paused).
+   */
+  void begin(Phase p) {
+    if (micros == NULL || depth >= PHASE_TIMER_MAX_DEPTH) {
+      return;
+    }
+    accountTop(micros());
+    stack[depth++] = p;
+    entries[p]++;
+  }
+
+  /**
+   * Stop timing a phase (the paused phase if any is resumed).
+   */
+  void end(Phase p) {
+    if (micros == NULL || depth == 0 || stack[depth - 1] != p) {
+      return;
+    }
+    accountTop(micros());
+    depth--;
+  }
+
+  /**
+   * Close the current cycle (to be invoked right before sleeping).
+   */
+  void endCycle() {
+    if (micros == NULL) {
+      return;
+    }
+    unsigned long n = micros();
+    accountTop(n);
+    current[PhaseDelimiter] = n - cycleStart;
+    awakeUs += current[PhaseDelimiter];
+    int slot = completed % PHASE_TIMER_CYCLES;
+    for (int p = 0; p <= PhaseDelimiter; p++) {
+      cycles[slot][p] = current[p];
+      current[p] = 0;
+    }
+    completed++;
+    if (persisted != NULL) {
+      for (int p = 0; p <= PhaseDelimiter; p++) {
+        persisted->cycleMs[p] = cycles[slot][p] / 1000;
+      }
+    }
+  }
+
+  /**
+   * Start a new cycle (to be invoked right after waking up from a non-resetting sleep).
+   */
+  void beginCycle() {
+    if (micros == NULL) {
+      return;
+    }
+    cycleStart = micros();
+    stackStart = cycleStart;
+  }
+
+  long getCompletedCycles() {
+    return completed;
+  }
+
+  long getEntries(Phase p) {
+    return entries[p];
+  }
+
+  unsigned long long getAwakeUs() {
+    return awakeUs;
+  }
+
+  /**
+   * Fill the buffer with the phases (in ms) of the last closed cycle (possibly the persisted one, closed before
+   * a deep sleep), returns false (buffer untouched) if there is no such cycle.
+   */
+  bool summary(Buffer *b) {
+    if (completed == 0 && (persisted == NULL || persisted->cycleMs[PhaseDelimiter] == 0)) {
+      return false;
+    }
+    b->clear();
+    for (int p = 0; p < PhaseDelimiter; p++) {
+      b->append(PhaseNames[p]);
+      b->append(':');
+      appendMs(b, lastCycleMs(p));
+      b->append(' ');
+    }
+    b->append("t:");
+    appendMs(b, lastCycleMs(PhaseDelimiter));
+    return true;
+  }
+
+  /**
+   * Log average and maximum duration (in us) of each phase over the cycles kept.
+   */
+  void report() {
+    int n = (completed < PHASE_TIMER_CYCLES ? completed : PHASE_TIMER_CYCLES);
+    log(CLASS_PHASE_TIMER, Info, "### Phases: last %d cycles of %ld (avg/max us)", n, completed);
+    if (n == 0) {
+      return;
+    }
+    for (int p = 0; p <= PhaseDelimiter; p++) {
+      unsigned long sum = 0;
+      unsigned long max = 0;
+      for (int c = 0; c < n; c++) {
+        sum += cycles[c][p];
+        max = (cycles[c][p] > max ? cycles[c][p] : max);
+      }
+      log(CLASS_PHASE_TIMER, Info, "### %s: %lu/%lu", (p == PhaseDelimiter ? "t" : PhaseNames[p]), sum / n, max);
+    }
+  }
+};
+
+PhaseTimer phaseTimer;
+
+#endif // PHASE_TIMER_INC
@@ -1,7 +1,13 @@
 #ifndef PLATFORM_INC
 #define PLATFORM_INC
 
+#include <Command.h>
 #include <Constants.h>
+#include <InputTrace.h>
+#include <LogCodec.h>
+#include <LogRing.h>
+#include <RtcState.h>
+#include <TuningStore.h>
 
 /**
  * This file contains common-to-any-platform declarations or functions:
@@ -20,20 +26,33 @@
 #define HTTP_TIMEOUT_MS 10000
 #endif // HTTP_TIMEOUT_MS
 
-#ifndef USER_INTERACTION_LOOPS_MAX
-#define USER_INTERACTION_LOOPS_MAX 40
-#endif // USER_INTERACTION_LOOPS_MAX
-
 #ifndef INVALID_THRESHOLD_SLEEP_CYCLE_SECS
 #define INVALID_THRESHOLD_SLEEP_CYCLE_SECS (3600*6)
 #endif // INVALID_THRESHOLD_SLEEP_CYCLE_SECS
 #ifndef QUESTION_ANSWER_MAX_LENGTH
 #define QUESTION_ANSWER_MAX_LENGTH 128
 #endif // QUESTION_ANSWER_MAX_LENGTH
+#ifndef VCC_OVERSAMPLING
+#define VCC_OVERSAMPLING 4 // amount of ADC readings averaged per Vcc measure
+#endif // VCC_OVERSAMPLING
+
+#ifndef WIFI_FAST_CONNECT_TIMEOUT_MS
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#endif // WIFI_FAST_CONNECT_TIMEOUT_MS
+
+#ifndef WIFI_LEASE_MAX_AGE_SECS
+#define WIFI_LEASE_MAX_AGE_SECS 3600 // age after which the cached DHCP lease is not reused (renewed via DHCP)
+#endif // WIFI_LEASE_MAX_AGE_SECS
+
+#ifndef SERVO_DRAIN_MAX_MS
+#define SERVO_DRAIN_MAX_MS 5000 // maximum time waited for the servos to complete their motion before sleeping
+#endif // SERVO_DRAIN_MAX_MS
+
 #ifndef WIFI_SKIP_IF_CONNECTED
 #define WIFI_SKIP_IF_CONNECTED true
 #endif // WIFI_SKIP_IF_CONNECTED
 Buffer *logBuffer = NULL;
+LogRing logRing; // written over the logBuffer storage
 ModuleSleepino *m = NULL;
 
 //////////////////////////////////////////////////////////////
@@ -112,23 +131,108 @@ int readRemainingSecs();
 // Write amount of seconds missing in deep sleep.
 void writeRemainingSecs(int s);
 
-// Get VCC measure in volts.
-float vcc();
+// Connect straight to the access point cached in RTC (no scan, no DHCP if the lease is recent enough), returns true if connected.
+bool initializeWifiFast(const char *ssid, const char *pass, const char *ssidb, const char *passb);
+
+// Cache in RTC the access point and lease of the current connection.
+void cacheWifi();
+
+// Read the RTC memory (persistent across deep sleep), returns true if success.
+bool readRtc(void *data, int length);
+
+// Write the RTC memory (persistent across deep sleep), returns true if success.
+bool writeRtc(const void *data, int length);
+
+// Get VCC measure in millivolts (oversampled).
+int vccMillivolts();
+
+// Get microseconds elapsed since boot (for fine-grained timing).
+unsigned long microsArchitecture();
 
 void askStringQuestion(const char *question, Buffer *answer);
 
+// Push to the display the changes not yet shown (if any).
+void displayFlush();
+
 // Generic functions common to all architectures
 ///////////////////
 
+// Read a file, tuning variables are served by the tuning store (migrated from their own file if not yet there).
+bool readFileTuned(const char *fname, Buffer *content) {
+  if (!TuningStore::isTuning(fname)) {
+    return readFile(fname, content);
+  }
+  return tuningStore.read(fname, content);
+}
+
+// Read a file (traced as an input).
+bool readFileCustom(const char *fname, Buffer *content) {
+  return inputTrace.file(fname, content, readFileTuned(fname, content));
+}
+
+// Read the RTC memory (traced as an input).
+bool readRtcCustom(void *data, int length) {
+  return inputTrace.bytes(InputTraceRtc, data, length, readRtc(data, length));
+}
+
+// Read Vcc (traced as an input).
+int vccMillivoltsCustom() {
+  return (int)inputTrace.value(InputTraceVcc, vccMillivolts());
+}
+
+unsigned long (*millisLive)() = NULL;
+
+// Read the millis source of the clock (traced as an input).
+unsigned long millisCustom() {
+  return (unsigned long)inputTrace.value(InputTraceMillis, (long)millisLive());
+}
+
+// Set the millis source of the clock (traced only if inputs are being traced, as it is read very often).
+void setExternalMillisCustom(unsigned long (*live)()) {
+  millisLive = live;
+  setExternalMillis(inputTrace.isRecording() || inputTrace.isReplaying() ? millisCustom : live);
+}
+
+// Set the time from the trace if replaying (traced as an input).
+void setTimeCustom(InputTraceKind kind) {
+  time_t live = now();
+  time_t t = (time_t)inputTrace.value(kind, (long)live);
+  if (t != live) { // replayed
+    setTime(t);
+  }
+}
+
+// Write a file, tuning variables go to the tuning store.
+bool writeFileCustom(const char *fname, const char *content) {
+  if (!TuningStore::isTuning(fname)) {
+    return writeFile(fname, content);
+  }
+  rtcState.clearTuning(fname); // read (and cached) again upon next wake
+  return tuningStore.set(fname, content);
+}
+
+// Remove a tuning variable (from the tuning store and from the RTC cache), returns false if absent.
+bool removeTuning(const char *fname) {
+  rtcState.clearTuning(fname);
+  return tuningStore.remove(fname);
+}
+
+// Secret (obfuscated) tuning variables are not cached in RTC memory (which is not encrypted).
 Buffer *initializeTuningVariable(Buffer **var, const char *filename, int maxLength, const char *defaultContent, bool obfuscate) {
   bool first = false;
   if (*var == NULL) {
     first = true;
-    *var = new Buffer(maxLength);
-    bool succValue = readFile(filename, *var); // read value from file
-    if (succValue && !(*var)->isEmpty()) {                           // managed to retrieve the value
+    *var = arena.make<Buffer>(maxLength);
+    const char *cached = (obfuscate ? NULL : rtcState.getTuning(filename));
+    if (cached != NULL) {                      // cached in RTC memory, no need to access the filesystem
+      log(CLASS_PLATFORM, Debug, "Read %s: RTC", filename);
+      (*var)->load(cached);
+    } else if (readFileCustom(filename, *var) && !(*var)->isEmpty()) { // managed to retrieve the value
       log(CLASS_PLATFORM, Debug, "Read %s: OK", filename);
       (*var)->replace('\n', 0);                // minor formatting
+      if (!obfuscate) {
+        rtcState.setTuning(filename, (*var)->getBuffer());
+      }
     } else if (defaultContent != NULL) {       // failed to retrieve value, use default content if provided
       log(CLASS_PLATFORM, Debug, "Read %s: KO", filename);
       log(CLASS_PLATFORM, Debug, "Using default: %s", defaultContent);
@@ -136,8 +240,11 @@ Buffer *initializeTuningVariable(Buffer **var, const char *filename, int maxLeng
     } else {
       Buffer buffer(QUESTION_ANSWER_MAX_LENGTH);
       askStringQuestion(filename, &buffer);
-      writeFile(filename, buffer.getBuffer());
+      writeFileCustom(filename, buffer.getBuffer());
       (*var)->fill(buffer.getBuffer());
+      if (!obfuscate) {
+        rtcState.setTuning(filename, buffer.getBuffer());
+      }
     }
   }
   if (first) {
@@ -151,6 +258,7 @@ Buffer *initializeTuningVariable(Buffer **var, const char *filename, int maxLeng
 }
 
 Buffer *getLogBuffer() {
+  logRing.linearize(); // in place, so that the buffer can be consumed as a regular string
   return logBuffer;
 }
 
@@ -172,10 +280,25 @@ Buffer *getLogBuffer() {
 bool initWifiSimple() {
   Settings *s = m->getModuleSettings();
   log(CLASS_PLATFORM, Info, "W.steady");
-  bool connected = initializeWifi(s->getSsid(), s->getPass(), s->getSsidBackup(), s->getPassBackup(), WIFI_SKIP_IF_CONNECTED, WIFI_CONNECTION_RETRIES);
+  phaseTimer.begin(PhaseWifi);
+  energyMeter.switchOn(EnergyWifi);
+  unsigned long start = microsArchitecture();
+  bool fast = initializeWifiFast(s->getSsid(), s->getPass(), s->getSsidBackup(), s->getPassBackup());
+  bool connected = fast || initializeWifi(s->getSsid(), s->getPass(), s->getSsidBackup(), s->getPassBackup(), WIFI_SKIP_IF_CONNECTED, WIFI_CONNECTION_RETRIES);
+  if (connected && !fast) {
+    cacheWifi();
+  }
+  rtcState.getData()->wifi.connectMs = (microsArchitecture() - start) / 1000;
+  log(CLASS_PLATFORM, Debug, "W.%s %lu ms", (fast ? "fast" : "scan"), (unsigned long)rtcState.getData()->wifi.connectMs);
+  phaseTimer.end(PhaseWifi);
   return connected;
 }
 
+void stopWifiSimple() {
+  stopWifi();
+  energyMeter.switchOff(EnergyWifi);
+}
+
 
 void commandFunc(const char* c) {
   m->command(c);
@@ -190,20 +313,49 @@ void updateFirmwareVersion(const char *targetVersion, const char *currentVersion
   }
 }
 
+// Complete ongoing motion (and power off) before sleeping, aborting it if it takes too long.
+void drainServoMotion() {
+  unsigned long begin = microsArchitecture();
+  while (servoMotion.tick()) {
+    if (microsArchitecture() - begin >= SERVO_DRAIN_MAX_MS * 1000UL) {
+      servoMotion.stop();
+      break;
+    }
+    heartbeat();
+  }
+}
+
+void deepSleepNotInterruptableRtc(time_t periodSecs) {
+  rtcState.sleeping(now(), periodSecs);
+  deepSleepNotInterruptable(now(), periodSecs);
+}
+
 void deepSleepNotInterruptableCustom(time_t cycleBegin, time_t periodSecs) {
+  long due = m->secsToNextDue(now());
+  if (due > 0) { // sleep until the next actor is due (possibly extended deep sleep)
+    log(CLASS_PLATFORM, Debug, "Next due: %lds (period %ds)", due, (int)periodSecs);
+    periodSecs = MINIM(due, INVALID_THRESHOLD_SLEEP_CYCLE_SECS);
+  }
+  drainServoMotion();
+  displayFlush();
+  phaseTimer.endCycle();
+  energyMeter.endCycle(EnergyDeepSleep, periodSecs);
   if (periodSecs > INVALID_THRESHOLD_SLEEP_CYCLE_SECS) {
     log(CLASS_PLATFORM, Warn, "Invalid DS: %d", periodSecs);
     writeRemainingSecs(0); // clean RTC for next boot
   } else if (periodSecs <= MAX_SLEEP_CYCLE_SECS) {
     log(CLASS_PLATFORM, Debug, "Regular DS %d", periodSecs);
     writeRemainingSecs(0); // clean RTC for next boot
-    deepSleepNotInterruptable(now(), periodSecs);
+    deepSleepNotInterruptableRtc(periodSecs);
   } else {
     int remaining = periodSecs - MAX_SLEEP_CYCLE_SECS;
     log(CLASS_PLATFORM, Debug, "EDS: %d(+%d rem.)", MAX_SLEEP_CYCLE_SECS, remaining);
     writeRemainingSecs(remaining);
-    deepSleepNotInterruptable(now(), MAX_SLEEP_CYCLE_SECS);
+    deepSleepNotInterruptableRtc(MAX_SLEEP_CYCLE_SECS);
   }
+  phaseTimer.beginCycle(); // only reached if deep sleep did not reset the device
+  energyMeter.beginCycle();
+  memoryMeter.beginCycle();
 }
 
 void resumeExtendedDeepSleepIfApplicable() {
@@ -214,11 +366,11 @@ void resumeExtendedDeepSleepIfApplicable() {
   } else if (remainingSecs > MAX_SLEEP_CYCLE_SECS) {
     log(CLASS_PLATFORM, Info, "EDS ongoing %d(+%d remaining)", MAX_SLEEP_CYCLE_SECS, remainingSecs);
     writeRemainingSecs(remainingSecs - MAX_SLEEP_CYCLE_SECS);
-    deepSleepNotInterruptable(now(), MAX_SLEEP_CYCLE_SECS);
+    deepSleepNotInterruptableRtc(MAX_SLEEP_CYCLE_SECS);
   } else if (remainingSecs > 0) {
     log(CLASS_PLATFORM, Info, "EDS ongoing %d (+0 remaining)", remainingSecs);
     writeRemainingSecs(0);
-    deepSleepNotInterruptable(now(), remainingSecs);
+    deepSleepNotInterruptableRtc(remainingSecs);
   } else {
     log(CLASS_PLATFORM, Info, "No EDS ongoing");
   }
@@ -226,7 +378,14 @@ void resumeExtendedDeepSleepIfApplicable() {
 
 bool sleepInterruptable(time_t cycleBegin, time_t periodSecs) {
   int msec = (m==NULL?1000:m->getModuleSettings()->miniPeriodMsec());
-  return lightSleepInterruptable(cycleBegin, periodSecs, msec, haveToInterrupt, heartbeat);
+  drainServoMotion();
+  displayFlush();
+  phaseTimer.endCycle();
+  energyMeter.endCycle(EnergyLightSleep, cycleBegin + periodSecs - now());
+  bool interrupted = lightSleepInterruptable(cycleBegin, periodSecs, msec, haveToInterrupt, heartbeat);
+  phaseTimer.beginCycle();
+  energyMeter.beginCycle();
+  return interrupted;
 }
 
 #endif // PLATFORM_INC
@@ -30,16 +30,27 @@
 
 #define LOG_BUFFER_MAX_LENGTH 1024
 
+#ifndef DEBUG_SERVICE_PERIOD_MS
+#define DEBUG_SERVICE_PERIOD_MS 100 // minimum time between two services of telnet / OTA
+#endif // DEBUG_SERVICE_PERIOD_MS
+
 #ifdef TELNET_ENABLED
 RemoteDebug telnet;
+TelnetSink telnetSink;
+#define TELNET_DROPPED telnetSink.getDropped()
+#else // TELNET_ENABLED
+#define TELNET_DROPPED 0L
 #endif // TELNET_ENABLED
 
 Buffer *apiDeviceId = NULL;
 Buffer *apiDevicePwd = NULL;
 Buffer *contrast = NULL;
 int currentLogLine = 0;
-Buffer *cmdBuffer = NULL;
-Buffer *cmdLast = NULL;
+LineEditor lineEditor;
+char telnetCommand[LINE_EDITOR_MAX_LENGTH + 1] = {0}; // received via telnet, pending execution
+bool debugStarted = false;
+unsigned long debugServiceLast = 0;
+unsigned long debugServiceMaxMs = 0; // longest service slice so far
 
 void debugHandle();
 void handleInterrupt();
@@ -54,10 +65,164 @@ const char *apiDevicePass() {
 
 void initLogBuffer() {
   if (logBuffer == NULL) {
-    logBuffer = new Buffer(LOG_BUFFER_MAX_LENGTH);
+    logBuffer = arena.make<Buffer>(LOG_BUFFER_MAX_LENGTH);
+    logRing.setup(logBuffer->getUnsafeBuffer(), LOG_BUFFER_MAX_LENGTH);
+  }
+}
+
+bool bufferLogEnabled() {
+  bool fsLogsEnabled = (m==NULL?true:m->getSleepinoSettings()->fsLogsEnabled());
+  if (fsLogsEnabled) {
+    initLogBuffer();
   }
+  return fsLogsEnabled;
 }
 
+void bufferLogTime() {
+  int ts = (int)((millis()/1000) % 10000);
+  char time[5] = {(char)('0' + ts / 1000), (char)('0' + ts / 100 % 10), (char)('0' + ts / 10 % 10), (char)('0' + ts % 10), '|'};
+  logRing.write(time, sizeof(time));
+}
+
+// Write a log line in the log ring (to be sent via network), prefixed with the uptime if a new line.
+void bufferLogLine(const char *str, bool newline) {
+  int fsLogsLength = (m==NULL?DEFAULT_FS_LOGS_LENGTH:m->getSleepinoSettings()->getFsLogsLength());
+  if (!bufferLogEnabled()) {
+    return;
+  }
+  if (newline) {
+    bufferLogTime();
+  }
+  int len = strlen(str);
+  int max = (fsLogsLength > 1 ? fsLogsLength - 1 : 0);
+  if (len >= max) { // truncate
+    logRing.write(str, max);
+    logRing.write("\n", 1);
+  } else {
+    logRing.write(str, len);
+  }
+}
+
+#ifndef LOG_SERIAL_ENABLED
+#define LOG_SERIAL_ENABLED true // print the logs in serial (can be disabled on devices with nothing plugged to it)
+#endif // LOG_SERIAL_ENABLED
+
+#ifdef LOG_DEFERRED_ENABLED
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 0 // same default as log4ino
+#endif // LOG_LEVEL
+
+#define LOG_DEFERRED_LINE_LENGTH 96 // formatted line for serial, telnet and LCD
+
+// Print a log line in serial, telnet and LCD (defined per platform, the log ring is not touched).
+void logLineLocal(const char *str);
+
+// Tell if any of serial, telnet and LCD takes log lines (defined per platform).
+bool logLineLocalEnabled();
+
+bool logProbing = false; // set while probing the log options (see logOptionsPass)
+bool logProbed = false;
+
+// Tell if the runtime log options of log4ino let pass a line of the given class and level
+// (an empty line is logged while probing, which logLine only flags instead of printing it).
+bool logOptionsPass(const char *clz, int level) {
+  logProbing = true;
+  logProbed = false;
+  log(clz, (LogLevel)level, "");
+  logProbing = false;
+  return logProbed;
+}
+
+// Write a deferred log record in the log ring (formatted by the host decoder, not here),
+// and its formatted line in the local outputs (if any is enabled).
+void logDeferred(const char *clz, int level, int id, ...) {
+  if (level < LOG_LEVEL || !logOptionsPass(clz, level)) { // same filters as log
+    return;
+  }
+  va_list args;
+  if (logLineLocalEnabled()) {
+    char line[LOG_DEFERRED_LINE_LENGTH];
+    va_start(args, id);
+    int l = snprintf(line, sizeof(line) - 1, "%s ", clz);
+    l += vsnprintf(line + l, sizeof(line) - 1 - l, LogFormatFormats[id], args);
+    va_end(args);
+    l = MINIM(l, (int)sizeof(line) - 2);
+    line[l++] = '\n';
+    line[l] = 0;
+    logLineLocal(line);
+  }
+  if (!bufferLogEnabled()) {
+    return;
+  }
+  char rec[LOG_DEFERRED_MAX_LENGTH];
+  va_start(args, id);
+  int n = logEncodeRecord(rec, sizeof(rec) - 1, clz, level, id, args);
+  va_end(args);
+  rec[n++] = '\n';
+  bufferLogTime();
+  logRing.write(rec, n);
+}
+#endif // LOG_DEFERRED_ENABLED
+
+
+#ifdef INPUT_TRACE_ENABLED
+// Input trace events go to serial, telnet and the logs sent via network (extract them with: grep -o 'TRACE .*').
+void inputTraceLog(const char *line) {
+  Serial.print(line);
+#ifdef TELNET_ENABLED
+  if (telnet.isActive()) {
+    telnetSink.append(line);
+  }
+#endif // TELNET_ENABLED
+  bufferLogLine(line, true);
+}
+#endif // INPUT_TRACE_ENABLED
+
+bool initializeWifiFast(const char *ssid, const char *pass, const char *ssidb, const char *passb) {
+  RtcWifi *w = &rtcState.getData()->wifi;
+  if (WiFi.status() == WL_CONNECTED) {
+    return WIFI_SKIP_IF_CONNECTED;
+  } else if (w->ssid == 0) {
+    return false;
+  } else if (now() < w->leaseTime || now() - w->leaseTime > WIFI_LEASE_MAX_AGE_SECS) {
+    log(CLASS_PLATFORM, Debug, "W.lease expired");
+    w->ssid = 0; // lease possibly reassigned by the router, renew it via DHCP
+    return false;
+  }
+  bool backup = (w->ssid != rtcCrc32((const uint8_t *)ssid, strlen(ssid)));
+  if (backup && w->ssid != rtcCrc32((const uint8_t *)ssidb, strlen(ssidb))) {
+    w->ssid = 0; // credentials changed
+    return false;
+  }
+  WiFi.mode(WIFI_STA);
+  WiFi.config(IPAddress(w->ip), IPAddress(w->gateway), IPAddress(w->subnet), IPAddress(w->dns));
+  WiFi.begin((backup ? ssidb : ssid), (backup ? passb : pass), w->channel, w->bssid);
+  unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED && millis() - start < WIFI_FAST_CONNECT_TIMEOUT_MS) {
+    delay(10);
+  }
+  if (WiFi.status() == WL_CONNECTED) {
+    return true;
+  }
+  log(CLASS_PLATFORM, Debug, "W.fast failed");
+  w->ssid = 0; // access point or lease no longer valid, next connections will scan
+  WiFi.disconnect();
+  WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0)); // back to DHCP
+  return false;
+}
+
+void cacheWifi() {
+  RtcWifi *w = &rtcState.getData()->wifi;
+  String ssid = WiFi.SSID();
+  w->ssid = rtcCrc32((const uint8_t *)ssid.c_str(), ssid.length());
+  memcpy(w->bssid, WiFi.BSSID(), sizeof(w->bssid));
+  w->channel = WiFi.channel();
+  w->ip = (uint32_t)WiFi.localIP();
+  w->gateway = (uint32_t)WiFi.gatewayIP();
+  w->subnet = (uint32_t)WiFi.subnetMask();
+  w->dns = (uint32_t)WiFi.dnsIP();
+  w->leaseTime = now();
+}
 
 void configureModeArchitecture() {
   handleInterrupt();
@@ -103,11 +268,17 @@ void messageFunc(int x, int y, int color, bool wrap, MsgClearMode clearMode, int
   lcd->setTextSize(size);
   lcd->setTextColor(color);
   lcd->setCursor(x * size * LCD_CHAR_WIDTH, y * size * LCD_CHAR_HEIGHT);
-  lcd->print(str);
-  lcd->display();
+  lcd->print(str); // pushed to the display upon flush
+#endif // LCD_ENABLED
+  logFmt(CLASS_PLATFORM, Debug, LogFmtPlatformMessage, x, y, str);
+}
+
+void displayFlush() {
+#ifdef LCD_ENABLED
+  if (lcd != NULL && lcd->flush()) {
+    delay(DELAY_MS_SPI);
+  }
 #endif // LCD_ENABLED
-  log(CLASS_PLATFORM, Debug, "Msg(%d,%d):%s", x, y, str);
-  delay(DELAY_MS_SPI);
 }
 
 
@@ -122,6 +293,7 @@ void restoreSafeFirmware() { // to be invoked as last resource when things go wr
 
 void askStringQuestion(const char *question, Buffer *answer) {
   log(CLASS_PLATFORM, User, "Question: %s", question);
+  displayFlush();
   Serial.setTimeout(QUESTION_ANSWER_TIMEOUT_MS);
   Serial.readBytesUntil('\n', answer->getUnsafeBuffer(), answer->getCapacity());
   answer->replace('\n', '\0');
@@ -135,72 +307,109 @@ void io(int pin, int val) {
 
 
 void reactCommandCustom() { // for the use via telnet
-  if (m == NULL) {
+#ifdef TELNET_ENABLED
+  // may be invoked from within a heartbeat (HTTP request, light sleep, ...), so execution is deferred
+  strncpy(telnetCommand, telnet.getLastCommand().c_str(), LINE_EDITOR_MAX_LENGTH);
+  telnetCommand[LINE_EDITOR_MAX_LENGTH] = 0;
+#endif // TELNET_ENABLED
+}
+
+#ifdef TELNET_ENABLED
+size_t telnetWrite(const uint8_t *b, size_t l) {
+  return telnet.write(b, l);
+}
+#endif // TELNET_ENABLED
+
+void debugStart() {
+  if (debugStarted) {
+    return;
+  }
+  log(CLASS_PLATFORM, Debug, "Initialize debuggers...");
+#ifdef TELNET_ENABLED
+  telnet.begin(apiDeviceLogin()); // Intialize the remote logging framework
+#endif // TELNET_ENABLED
+#ifdef OTA_ENABLED
+  ArduinoOTA.begin();             // Intialize OTA
+#endif // OTA_ENABLED
+  debugStarted = true;
+}
+
+// Service telnet and OTA once (non-blocking), at most once per period so that frequent callers stay cheap.
+void debugService() {
+  if (!debugStarted || m == NULL || !m->getModuleSettings()->getDebug()) {
+    return;
+  }
+  unsigned long start = millis();
+  if (start - debugServiceLast < DEBUG_SERVICE_PERIOD_MS) {
     return;
   }
 #ifdef TELNET_ENABLED
-  m->command(telnet.getLastCommand().c_str());
+  telnet.handle();     // Handle telnet log server and commands
+  if (telnet.isActive()) {
+    telnetSink.flush();  // Send pending logs
+  } else {
+    telnetSink.clear();
+  }
 #endif // TELNET_ENABLED
+#ifdef OTA_ENABLED
+  ArduinoOTA.handle(); // Handle on the air firmware load
+#endif // OTA_ENABLED
+  debugServiceLast = millis();
+  debugServiceMaxMs = MAXIM(debugServiceMaxMs, debugServiceLast - start);
 }
 
+void pollSerial();
+
 void heartbeat() {
   espWdtFeed();
+  pollSerial();
+  debugService();
+  servoMotion.tick();
+  memoryMeter.sample();
 }
 
-void handleInterrupt() {
-  if (Serial.available()) {
-    // Handle serial commands
-    uint8_t c;
-
-    while (true) {
-      int inLoop = 0;
-      size_t n = Serial.readBytes(&c, 1);
-
-      if (c == 0x08 && n == 1) { // backspace
-        log(CLASS_PLATFORM, Debug, "Backspace");
-        if (cmdBuffer->getLength() > 0) {
-          cmdBuffer->getUnsafeBuffer()[cmdBuffer->getLength() - 1] = 0;
-        }
-      } else if (c == 0x1b && n == 1) { // up/down
-        log(CLASS_PLATFORM, Debug, "Up/down");
-        cmdBuffer->load(cmdLast->getBuffer());
-      } else if (c == '\n' && n == 1) { // if enter is pressed...
-        log(CLASS_PLATFORM, Debug, "Enter");
-        cmdBuffer->replace('\n', 0);
-        cmdBuffer->replace('\r', 0);
-        if (cmdBuffer->getLength() > 0) {
-          CmdExecStatus execStatus = m->command(cmdBuffer->getBuffer());
-          bool interrupt = (execStatus == ExecutedInterrupt);
-          log(CLASS_PLATFORM, Debug, "Interrupt: %d", interrupt);
-          log(CLASS_PLATFORM, Debug, "Cmd status: %s", CMD_EXEC_STATUS(execStatus));
-          log(CLASS_PLATFORM, User, "('%s' => %s)", cmdBuffer->getBuffer(), CMD_EXEC_STATUS(execStatus));
-          cmdLast->load(cmdBuffer->getBuffer());
-          cmdBuffer->clear();
-        }
-        break;
-      } else if (n == 1) {
-        cmdBuffer->append(c);
-      }
-      // echo
-      log(CLASS_PLATFORM, User, "> %s (%d)", cmdBuffer->getBuffer(), (int)c);
-      while (!Serial.available() && inLoop < USER_INTERACTION_LOOPS_MAX) {
-        inLoop++;
-        delay(100);
-      }
-      if (inLoop >= USER_INTERACTION_LOOPS_MAX) {
-        log(CLASS_PLATFORM, User, "> (timeout)");
-        break;
-      }
-    }
-    log(CLASS_PLATFORM, Debug, "Done with interrupt");
+unsigned long microsArchitecture() {
+  return micros();
+}
 
+void serialEcho(const char *s) {
+  Serial.print(s);
+}
+
+// Feed the line editor with the bytes received (non-blocking).
+void pollSerial() {
+  while (!lineEditor.hasLine() && Serial.available() > 0) {
+    lineEditor.feed(Serial.read());
+  }
+}
+
+void executeCommand(const char *cmd) {
+  inputTrace.recordCommand(cmd);
+  CmdExecStatus execStatus = m->command(cmd);
+  log(CLASS_PLATFORM, Debug, "Cmd status: %s", CMD_EXEC_STATUS(execStatus));
+  log(CLASS_PLATFORM, User, "('%s' => %s)", cmd, CMD_EXEC_STATUS(execStatus));
+}
+
+void handleInterrupt() {
+  pollSerial();
+  if (lineEditor.hasLine()) {
+    executeCommand(lineEditor.getLine());
+    lineEditor.consume();
+  }
+  if (telnetCommand[0] != 0) {
+    executeCommand(telnetCommand);
+    telnetCommand[0] = 0;
   }
 }
 
 bool haveToInterrupt() {
-  if (Serial.available()) {
+  pollSerial();
+  if (lineEditor.hasLine()) {
     log(CLASS_PLATFORM, Debug, "Serial pinged: int");
     return true;
+  } else if (telnetCommand[0] != 0) {
+    log(CLASS_PLATFORM, Debug, "Telnet pinged: int");
+    return true;
   } else {
     return false;
   }
@@ -1,5 +1,6 @@
 #include <Adafruit_GFX.h>      // include adafruit graphics library
 #include <Adafruit_PCD8544.h>  // include adafruit PCD8544 (Nokia 5110) library
+#include <Pcd8544Display.h>
 #include <Arduino.h>
 #include <Platform.h>
 #ifdef OTA_ENABLED
@@ -10,6 +11,8 @@
 #include <HTTPUpdate.h>
 //#include <EspSaveCrash.h> // not supported for ESP32
 #include <FS.h>
+#include <LineEditor.h>
+#include <TelnetSink.h>
 #include <Pinout.h>
 #ifdef TELNET_ENABLED
 #include <RemoteDebug.h>
@@ -18,11 +21,9 @@
 #include <Wire.h>
 #include <primitives/BoardESP32.h>
 
-#ifndef TELNET_HANDLE_DELAY_MS
-#define TELNET_HANDLE_DELAY_MS 240000 // 4 minutes
-#endif // TELNET_HANDLE_DELAY_MS
-
 #define MAX_SLEEP_CYCLE_SECS 2419200 // 4 weeks
+#define SERVO_SETTLE_MIN_MS 60 // minimum time for a servo to reach its position
+#define SERVO_SETTLE_MS_PER_DEGREE 2 // (around 0.12s/60deg at 5V)
 
 #define FORMAT_SPIFFS_IF_FAILED true
 
@@ -36,7 +37,7 @@
 #define HELP_COMMAND_ARCH_CLI                                                                                                              \
   "\n  ESP32 HELP"                                                                                                                         \
   "\n  init              : initialize essential settings (wifi connection, logins, etc.)"                                                  \
-  "\n  rm ...            : remove file in FS "                                                                                             \
+  "\n  rm ...            : remove file in FS (or tuning variable) "                                                                        \
   "\n  lcdcont ...       : change lcd contrast"                                                                                            \
   "\n  ls                : list files present in FS "                                                                                      \
   "\n  reset             : reset the device"                                                                                               \
@@ -44,13 +45,15 @@
   "\n  lightsleep ...    : light sleep N provided seconds"                                                                                 \
   "\n"
 
-Adafruit_PCD8544* lcd = NULL;
+Pcd8544Display* lcd = NULL;
+
+RTC_DATA_ATTR RtcStateData rtcMemory; // survives deep sleep
 
 #include <PlatformESP.h>
 
 
 
-float vcc();
+int vccMillivolts();
 void reactCommandCustom();
 void heartbeat();
 bool lightSleepInterruptable(time_t cycleBegin, time_t periodSecs);
@@ -68,35 +71,42 @@ int lcdContrast();
 
 void servo(int idx, int pos) { }
 
-float vcc() {
-  return 3.3; // not supported.
+uint32_t heapFree() {
+  return ESP.getFreeHeap();
 }
 
-void logLine(const char *str, const char *clz, LogLevel l, bool newline) {
-  int ts = (int)((millis()/1000) % 10000);
-  Buffer time(8);
-  time.fill("%04d|", ts);
+uint32_t heapMaxBlock() {
+  return ESP.getMaxAllocHeap();
+}
+
+uint32_t stackFree() {
+  return uxTaskGetStackHighWaterMark(NULL); // FreeRTOS paints the stack of the loop task
+}
+
+int vccMillivolts() {
+  return 3300; // not supported.
+}
+
+void logLineLocal(const char *str) {
   // serial print
   /*
 Serial.print("HEA:");
 Serial.print(ESP.getFreeHeap());
 Serial.print("|");
 Serial.print("VCC:");
-Serial.print(VCC_FLOAT);
+Serial.print(vccMillivolts());
 Serial.print("|");
 */
-  Serial.print(str);
+  if (LOG_SERIAL_ENABLED) {
+    Serial.print(str);
+  }
   // telnet print
 #ifdef TELNET_ENABLED
   if (telnet.isActive()) {
-    for (unsigned int i = 0; i < strlen(str); i++) {
-      telnet.write(str[i]);
-    }
+    telnetSink.append(str); // sent in chunks (upon debug service at the latest)
   }
 #endif // TELNET_ENABLED
   bool lcdLogsEnabled = (m==NULL?true:m->getSleepinoSettings()->getLcdLogs());
-  bool fsLogsEnabled = (m==NULL?true:m->getSleepinoSettings()->fsLogsEnabled());
-  int fsLogsLength = (m==NULL?DEFAULT_FS_LOGS_LENGTH:m->getSleepinoSettings()->getFsLogsLength());
 
   // lcd print
   if (lcd != NULL && lcdLogsEnabled) { // can be called before LCD initialization
@@ -108,24 +118,31 @@ Serial.print("|");
     lcd->setTextSize(1);
     lcd->setTextColor(BLACK);
     lcd->setCursor(0, line * LCD_CHAR_HEIGHT);
-    lcd->print(str);
-    lcd->display();
+    lcd->print(str); // pushed to the display upon flush
 #endif // LCD_ENABLED
-    delay(DELAY_MS_SPI);
   }
-  // local logs (to be sent via network)
-  if (fsLogsEnabled) {
-    initLogBuffer();
-    if (newline) {
-      logBuffer->append(time.getBuffer());
-    }
-    unsigned int s = (unsigned int)(fsLogsLength) + 1;
-    char aux2[s];
-    strncpy(aux2, str, s);
-    aux2[s - 1] = 0;
-    aux2[s - 2] = '\n';
-    logBuffer->append(aux2);
+}
+
+bool logLineLocalEnabled() {
+  bool lcdLogsEnabled = (m==NULL?true:m->getSleepinoSettings()->getLcdLogs());
+#ifdef TELNET_ENABLED
+  if (telnet.isActive()) {
+    return true;
   }
+#endif // TELNET_ENABLED
+  return LOG_SERIAL_ENABLED || (lcd != NULL && lcdLogsEnabled);
+}
+
+void logLine(const char *str, const char *clz, LogLevel l, bool newline) {
+#ifdef LOG_DEFERRED_ENABLED
+  if (logProbing) { // the line passed the log options, nothing to print
+    logProbed = true;
+    return;
+  }
+#endif // LOG_DEFERRED_ENABLED
+  logLineLocal(str);
+  // local logs (to be sent via network)
+  bufferLogLine(str, newline);
 }
 
 void clearDevice() {
@@ -183,19 +200,30 @@ void setupArchitecture() {
   Serial.begin(115200);     // Initialize serial port
   Serial.setTimeout(1000); // Timeout for read
   setupLog(logLine);
+#ifdef INPUT_TRACE_ENABLED
+  inputTrace.setup(inputTraceLog, NULL); // record only (traces are replayed in the simulator)
+#endif // INPUT_TRACE_ENABLED
+
+  log(CLASS_PLATFORM, Debug, "Setup RTC");
+  rtcState.setup(readRtcCustom, writeRtc);
+  if (now() < rtcState.expectedTime()) { // clock reset by deep sleep
+    setTime(rtcState.expectedTime());
+  }
 
   log(CLASS_PLATFORM, Debug, "Setup cmds");
-  cmdBuffer = new Buffer(COMMAND_MAX_LENGTH);
-  cmdLast = new Buffer(COMMAND_MAX_LENGTH);
+  lineEditor.setup(serialEcho);
 
   log(CLASS_PLATFORM, Debug, "Setup timing");
-  setExternalMillis(millis);
+  setExternalMillisCustom(millis);
+  energyMeter.setCpuMhz(ESP.getCpuFreqMHz());
+  memoryMeter.setup(heapFree, heapMaxBlock, stackFree);
   
   heartbeat(); 
   
   log(CLASS_PLATFORM, Debug, "Setup SPIFFS");
   SPIFFS.begin(FORMAT_SPIFFS_IF_FAILED);
   
+  phaseTimer.begin(PhaseStartup);
   startup(
     PROJECT_ID,
     STRINGIFY(PROJ_VERSION),
@@ -205,6 +233,7 @@ void setupArchitecture() {
     cleanFailures,
     restoreSafeFirmware
   );
+  phaseTimer.end(PhaseStartup);
 
 
   log(CLASS_PLATFORM, Debug, "Setup wifi");
@@ -213,8 +242,11 @@ void setupArchitecture() {
   heartbeat();
   log(CLASS_PLATFORM, Debug, "Setup LCD");
 #ifdef LCD_ENABLED
-  lcd = new Adafruit_PCD8544(LCD_CLK_PIN, LCD_DIN_PIN, LCD_DC_PIN, LCD_CS_PIN, LCD_RST_PIN);
+  phaseTimer.begin(PhaseLcd);
+  lcd = arena.make<Pcd8544Display>(LCD_CLK_PIN, LCD_DIN_PIN, LCD_DC_PIN, LCD_CS_PIN, LCD_RST_PIN);
   lcd->begin(lcdContrast(), LCD_DEFAULT_BIAS);
+  energyMeter.switchOn(EnergyLcd);
+  phaseTimer.end(PhaseLcd);
 #endif // LCD_ENABLED
   delay(DELAY_MS_SPI);
 
@@ -225,6 +257,7 @@ void setupArchitecture() {
   log(CLASS_PLATFORM, Debug, "Setup commands");
 #ifdef TELNET_ENABLED
   telnet.setCallBackProjectCmds(reactCommandCustom);
+  telnetSink.setup(telnetWrite);
   String helpCli("Type 'help' for help");
   telnet.setHelpProjectsCmds(helpCli);
 #endif // TELNET_ENABLED
@@ -233,11 +266,11 @@ void setupArchitecture() {
 }
 
 void runModeArchitecture() {
-  Buffer timeAux(32);
+  static Buffer timeAux(32); // allocated once (not upon every loop)
   Timing::humanize(m->getClock()->currentTime(), &timeAux);
   timeAux.replace(' ', '\n');
 
-  Buffer lcdAux(64);
+  static Buffer lcdAux(64);
 
   lcdAux.fill("%s\nV:%s", timeAux.getBuffer(), STRINGIFY(PROJ_VERSION));
   logRaw(CLASS_PLATFORM, Debug, lcdAux.getBuffer());
@@ -251,54 +284,91 @@ void runModeArchitecture() {
 }
 
 CmdExecStatus commandArchitecture(const char *c) {
-  if (strcmp("init", c) == 0) {
-    logRaw(CLASS_PLATFORM, User, "-> Initialize");
-    logRaw(CLASS_PLATFORM, User, "Execute:");
-    logRaw(CLASS_PLATFORM, User, "   ls");
-    log(CLASS_PLATFORM, User, "   save %s <alias>", DEVICE_ALIAS_FILENAME);
-    log(CLASS_PLATFORM, User, "   save %s <pwd>", DEVICE_PWD_FILENAME);
-    logRaw(CLASS_PLATFORM, User, "   wifissid <ssid>");
-    logRaw(CLASS_PLATFORM, User, "   wifipass <password>");
-    log(CLASS_PLATFORM, User, "   save %s <contrast-0-100>", DEVICE_CONTRAST_FILENAME);
-    logRaw(CLASS_PLATFORM, User, "   (setup of power consumption settings architecture specific if any)");
-    logRaw(CLASS_PLATFORM, User, "   store");
-    logRaw(CLASS_PLATFORM, User, "   ls");
-    return Executed;
-  } else if (strcmp("ls", c) == 0) {
-    File root = SPIFFS.open("/");
-    File file = root.openNextFile();
-    while(file) {
-      log(CLASS_PLATFORM, User, "- %s (%d bytes)", file.name(), (int)file.size());
-      file = root.openNextFile();
-    }
-    return Executed;
-  } else if (strcmp("rm", c) == 0) {
-    const char *f = strtok(NULL, " ");
-    bool succ = SPIFFS.remove(f);
-    log(CLASS_PLATFORM, User, "### File '%s' %s removed", f, (succ?"":"NOT"));
-    return Executed;
-  } else if (strcmp("lcdcont", c) == 0) {
-    const char *c = strtok(NULL, " ");
-    int i = atoi(c);
-    log(CLASS_PLATFORM, User, "Set contrast to: %d", i);
-    lcd->setContrast(i);
-    return Executed;
-  } else if (strcmp("reset", c) == 0) {
-    ESP.restart(); // it is normal that it fails if invoked the first time after firmware is written
-    return Executed;
-  } else if (strcmp("deepsleep", c) == 0) {
-    int s = atoi(strtok(NULL, " "));
-    deepSleepNotInterruptableSecs(now(), s);
-    return Executed;
-  } else if (strcmp("lightsleep", c) == 0) {
-    int s = atoi(strtok(NULL, " "));
-    return (sleepInterruptable(now(), s)? ExecutedInterrupt: Executed);
-  } else if (strcmp("help", c) == 0 || strcmp("?", c) == 0) {
-    logRaw(CLASS_PLATFORM, User, HELP_COMMAND_ARCH_CLI);
-    return Executed;
-  } else {
-    return NotFound;
+  switch (commandHash(c)) {
+    case commandHash("init"):
+      if (commandIs(c, "init")) {
+        logRaw(CLASS_PLATFORM, User, "-> Initialize");
+        logRaw(CLASS_PLATFORM, User, "Execute:");
+        logRaw(CLASS_PLATFORM, User, "   ls");
+        log(CLASS_PLATFORM, User, "   save %s <alias>", DEVICE_ALIAS_FILENAME);
+        log(CLASS_PLATFORM, User, "   save %s <pwd>", DEVICE_PWD_FILENAME);
+        logRaw(CLASS_PLATFORM, User, "   wifissid <ssid>");
+        logRaw(CLASS_PLATFORM, User, "   wifipass <password>");
+        log(CLASS_PLATFORM, User, "   save %s <contrast-0-100>", DEVICE_CONTRAST_FILENAME);
+        logRaw(CLASS_PLATFORM, User, "   (setup of power consumption settings architecture specific if any)");
+        logRaw(CLASS_PLATFORM, User, "   store");
+        logRaw(CLASS_PLATFORM, User, "   ls");
+        return Executed;
+      }
+      break;
+    case commandHash("ls"):
+      if (commandIs(c, "ls")) {
+        File root = SPIFFS.open("/");
+        File file = root.openNextFile();
+        while(file) {
+          log(CLASS_PLATFORM, User, "- %s (%d bytes)", file.name(), (int)file.size());
+          file = root.openNextFile();
+        }
+        return Executed;
+      }
+      break;
+    case commandHash("rm"):
+      if (commandIs(c, "rm")) {
+        const char *f = strtok(NULL, " ");
+        bool succ = (TuningStore::isTuning(f) ? removeTuning(f) : SPIFFS.remove(f));
+        log(CLASS_PLATFORM, User, "### File '%s' %s removed", f, (succ?"":"NOT"));
+        return Executed;
+      }
+      break;
+    case commandHash("lcdcont"):
+      if (commandIs(c, "lcdcont")) {
+        const char *c = strtok(NULL, " ");
+        int i = atoi(c);
+        log(CLASS_PLATFORM, User, "Set contrast to: %d", i);
+        lcd->setContrast(i);
+        return Executed;
+      }
+      break;
+    case commandHash("reset"):
+      if (commandIs(c, "reset")) {
+        ESP.restart(); // it is normal that it fails if invoked the first time after firmware is written
+        return Executed;
+      }
+      break;
+    case commandHash("deepsleep"):
+      if (commandIs(c, "deepsleep")) {
+        int s = atoi(strtok(NULL, " "));
+        deepSleepNotInterruptableSecs(now(), s);
+        return Executed;
+      }
+      break;
+    case commandHash("lightsleep"):
+      if (commandIs(c, "lightsleep")) {
+        int s = atoi(strtok(NULL, " "));
+        return (sleepInterruptable(now(), s)? ExecutedInterrupt: Executed);
+      }
+      break;
+    case commandHash("help"):
+    case commandHash("?"):
+      if (commandIs(c, "help") || commandIs(c, "?")) {
+        logRaw(CLASS_PLATFORM, User, HELP_COMMAND_ARCH_CLI);
+        return Executed;
+      }
+      break;
+    default:
+      break;
   }
+  return NotFound;
+}
+
+bool readRtc(void *data, int length) {
+  memcpy(data, &rtcMemory, MINIM(length, (int)sizeof(rtcMemory)));
+  return length <= (int)sizeof(rtcMemory);
+}
+
+bool writeRtc(const void *data, int length) {
+  memcpy(&rtcMemory, data, MINIM(length, (int)sizeof(rtcMemory)));
+  return length <= (int)sizeof(rtcMemory);
 }
 
 int readRemainingSecs() {
@@ -318,32 +388,13 @@ void debugHandle() {
   if (!m->getModuleSettings()->getDebug()) {
     return;
   }
-  static bool firstTime = true;
   Serial.setDebugOutput(m->getModuleSettings()->getDebug()); // deep HW logs
-  if (firstTime) {
-    log(CLASS_PLATFORM, Debug, "Initialize debuggers...");
-#ifdef TELNET_ENABLED
-    telnet.begin(apiDeviceLogin()); // Intialize the remote logging framework
-#endif // TELNET_ENABLED
-#ifdef OTA_ENABLED
-    ArduinoOTA.begin();             // Intialize OTA
-#endif // OTA_ENABLED
-    firstTime = false;
-  }
+  debugStart(); // serviced from then on by the heartbeat (loop, light sleeps, HTTP requests)
 
-  m->getSleepinoSettings()->getStatus()->fill("freeheap:%d/%d", ESP.getFreeHeap(), ESP.getHeapSize());
-  m->getSleepinoSettings()->getMetadata()->changed();
+  m->getSleepinoSettings()->getStatus()->fill("heap:%ld dbg:%lums tdrop:%ld ldrop:%ld", MemoryMeter::figure(memoryMeter.getMinFreeHeap()), debugServiceMaxMs, TELNET_DROPPED, logRing.getDropped()); // minimum free heap
+  m->getSleepinoSettings()->changedProp(SleepinoSettingsStatusProp);
 
-#ifdef TELNET_ENABLED
-  log(CLASS_PLATFORM, User, "telnet?");
-  for (int i = 0; i < TELNET_HANDLE_DELAY_MS/1000; i++) {
-    telnet.handle();     // Handle telnet log server and commands
-    delay(1000);
-  }
-#endif // TELNET_ENABLED
-#ifdef OTA_ENABLED
-  ArduinoOTA.handle(); // Handle on the air firmware load
-#endif // OTA_ENABLED
+  debugService();
 }
 
 
@@ -1,5 +1,6 @@
 #include <Adafruit_GFX.h>      // include adafruit graphics library
 #include <Adafruit_PCD8544.h>  // include adafruit PCD8544 (Nokia 5110) library
+#include <Pcd8544Display.h>
 #include <Arduino.h>
 #include <Platform.h>
 #ifdef OTA_ENABLED
@@ -10,6 +11,8 @@
 #include <ESP8266httpUpdate.h>
 #include <EspSaveCrash.h>
 #include <FS.h>
+#include <LineEditor.h>
+#include <TelnetSink.h>
 #include <Pinout.h>
 #ifdef TELNET_ENABLED
 #include <RemoteDebug.h>
@@ -17,11 +20,9 @@
 #include <Servo.h>
 #include <primitives/BoardESP8266.h>
 
-#ifndef TELNET_HANDLE_DELAY_MS
-#define TELNET_HANDLE_DELAY_MS 240000 // 4 minutes
-#endif // TELNET_HANDLE_DELAY_MS
-
 #define MAX_SLEEP_CYCLE_SECS 1800 // 30min
+#define SERVO_SETTLE_MIN_MS 60 // minimum time for a servo to reach its position
+#define SERVO_SETTLE_MS_PER_DEGREE 2 // (around 0.12s/60deg at 5V)
 
 
 
@@ -33,21 +34,20 @@
 
 #define NEXT_LOG_LINE_ALGORITHM ((currentLogLine + 1) % 6)
 
-#define VCC_FLOAT ((float)ESP.getVcc() / 1024)
+#define VCC_MVOLTS ((int)(((long)ESP.getVcc() * 1000) >> 10)) // single reading, ADC unit is 1/1024 V
 
 extern "C" {
 #include "user_interface.h"
 }
 
-struct { // 512 bytes can be stored
-  uint32_t crc32;
-  int remainingSecs;
-} rtcData;
+// RTC user memory is 512 bytes, the first 128 ones (32 blocks) are used by eboot (OTA)
+#define RTC_STATE_OFFSET_BLOCKS 32
+static_assert(sizeof(RtcStateData) <= 512 - RTC_STATE_OFFSET_BLOCKS * 4, "RTC state does not fit in RTC user memory");
 
 #define HELP_COMMAND_ARCH_CLI                                                                                                              \
   "\n  ESP8266 HELP"                                                                                                                       \
   "\n  init              : initialize essential settings (wifi connection, logins, etc.)"                                                  \
-  "\n  rm ...            : remove file in FS "                                                                                             \
+  "\n  rm ...            : remove file in FS (or tuning variable) "                                                                        \
   "\n  lcdcont ...       : change lcd contrast"                                                                                            \
   "\n  ls                : list files present in FS "                                                                                      \
   "\n  reset             : reset the device"                                                                                               \
@@ -57,7 +57,7 @@ struct { // 512 bytes can be stored
   "\n  clearstack        : clear stack trace "                                                                                             \
   "\n"
 
-Adafruit_PCD8544* lcd = NULL;
+Pcd8544Display* lcd = NULL;
 
 #include <PlatformESP.h>
 
@@ -67,7 +67,7 @@ EspSaveCrash espSaveCrash;
 
 ADC_MODE(ADC_VCC);
 
-float vcc();
+int vccMillivolts();
 void reactCommandCustom();
 void heartbeat();
 bool lightSleepInterruptable(time_t cycleBegin, time_t periodSecs);
@@ -85,50 +85,63 @@ int lcdContrast();
 // Callbacks
 ///////////////////
 
-void servo(int idx, int pos) {
+void servo(int idx, int pos) { // non-blocking, settling is handled by the servo motion engine
   switch (idx) {
-    case 0: 
-      servo0.attach(SERVO0_PIN);
-      for (int i = 0; i < 10; i++) {
+    case 0:
+      if (pos == SERVO_RELEASE) {
+        servo0.detach();
+      } else {
+        if (!servo0.attached()) {
+          servo0.attach(SERVO0_PIN);
+        }
         servo0.write(pos);
-        delay(60);
       }
-      servo0.detach();
       break;
     default:
       break;
   }
 }
 
-float vcc() {
-  return VCC_FLOAT;
+uint32_t heapFree() {
+  return ESP.getFreeHeap();
 }
 
-void logLine(const char *str, const char *clz, LogLevel l, bool newline) {
-  int ts = (int)((millis()/1000) % 10000);
-  Buffer time(8);
-  time.fill("%04d|", ts);
+uint32_t heapMaxBlock() {
+  return ESP.getMaxFreeBlockSize();
+}
+
+uint32_t stackFree() {
+  return ESP.getFreeContStack(); // the core paints the stack of the loop
+}
+
+int vccMillivolts() {
+  long sum = 0;
+  for (int i = 0; i < VCC_OVERSAMPLING; i++) {
+    sum += ESP.getVcc();
+  }
+  return (int)((sum * 1000) / (1024L * VCC_OVERSAMPLING));
+}
+
+void logLineLocal(const char *str) {
   // serial print
+  if (LOG_SERIAL_ENABLED) {
 #ifdef HEAP_VCC_LOG
-  //Serial.print("HEA:");
-  //Serial.print(ESP.getFreeHeap()); // caused a crash, reenable upon upgrade
-  //Serial.print("|");
-  Serial.print("VCC:");
-  Serial.print(VCC_FLOAT);
-  Serial.print("|");
+    Serial.print("HEA:");
+    Serial.print(MemoryMeter::figure(memoryMeter.getMinFreeHeap())); // as sampled, -1 until then (querying the heap while logging caused crashes)
+    Serial.print("|");
+    Serial.print("VCC:");
+    Serial.print(VCC_MVOLTS);
+    Serial.print("|");
 #endif // HEAP_VCC_LOG
-  Serial.print(str);
+    Serial.print(str);
+  }
   // telnet print
 #ifdef TELNET_ENABLED
   if (telnet.isActive()) {
-    for (unsigned int i = 0; i < strlen(str); i++) {
-      telnet.write(str[i]);
-    }
+    telnetSink.append(str); // sent in chunks (upon debug service at the latest)
   }
 #endif // TELNET_ENABLED
   bool lcdLogsEnabled = (m==NULL?true:m->getSleepinoSettings()->getLcdLogs());
-  bool fsLogsEnabled = (m==NULL?true:m->getSleepinoSettings()->fsLogsEnabled());
-  int fsLogsLength = (m==NULL?DEFAULT_FS_LOGS_LENGTH:m->getSleepinoSettings()->getFsLogsLength());
 
   // lcd print
   if (lcd != NULL && lcdLogsEnabled) { // can be called before LCD initialization
@@ -140,24 +153,31 @@ void logLine(const char *str, const char *clz, LogLevel l, bool newline) {
     lcd->setTextSize(1);
     lcd->setTextColor(BLACK);
     lcd->setCursor(0, line * LCD_CHAR_HEIGHT);
-    lcd->print(str);
-    lcd->display();
+    lcd->print(str); // pushed to the display upon flush
 #endif // LCD_ENABLED
-    delay(DELAY_MS_SPI);
   }
-  // local logs (to be sent via network)
-  if (fsLogsEnabled) {
-    initLogBuffer();
-    if (newline) {
-      logBuffer->append(time.getBuffer());
-    }
-    unsigned int s = (unsigned int)(fsLogsLength) + 1;
-    char aux2[s];
-    strncpy(aux2, str, s);
-    aux2[s - 1] = 0;
-    aux2[s - 2] = '\n';
-    logBuffer->append(aux2);
+}
+
+bool logLineLocalEnabled() {
+  bool lcdLogsEnabled = (m==NULL?true:m->getSleepinoSettings()->getLcdLogs());
+#ifdef TELNET_ENABLED
+  if (telnet.isActive()) {
+    return true;
+  }
+#endif // TELNET_ENABLED
+  return LOG_SERIAL_ENABLED || (lcd != NULL && lcdLogsEnabled);
+}
+
+void logLine(const char *str, const char *clz, LogLevel l, bool newline) {
+#ifdef LOG_DEFERRED_ENABLED
+  if (logProbing) { // the line passed the log options, nothing to print
+    logProbed = true;
+    return;
   }
+#endif // LOG_DEFERRED_ENABLED
+  logLineLocal(str);
+  // local logs (to be sent via network)
+  bufferLogLine(str, newline);
 }
 
 void clearDevice() {
@@ -176,7 +196,7 @@ void infoArchitecture() {
   log(CLASS_PLATFORM, User, "Crashes:%d", espSaveCrash.count());
   log(CLASS_PLATFORM, User, "IP: %s", WiFi.localIP().toString().c_str());
   log(CLASS_PLATFORM, User, "Uptime:%luh", (millis() / 1000) / 3600);
-  log(CLASS_PLATFORM, User, "Vcc: %0.2f", VCC_FLOAT);
+  log(CLASS_PLATFORM, User, "Vcc: %dmV", vccMillivolts());
 }
 
 void testArchitecture() {}
@@ -206,6 +226,7 @@ void reportFailureLogs() {
   if (fsLogsEnabled) {
     initLogBuffer();
     espSaveCrash.print(logBuffer->getUnsafeBuffer(), LOG_BUFFER_MAX_LENGTH);
+    logRing.reload();
     writeFile(STACKTRACE_LOG_FILENAME, logBuffer->getBuffer());
   }
 
@@ -234,16 +255,27 @@ void setupArchitecture() {
   Serial.begin(115200);     // Initialize serial port
   Serial.setTimeout(1000); // Timeout for read
   setupLog(logLine);
+#ifdef INPUT_TRACE_ENABLED
+  inputTrace.setup(inputTraceLog, NULL); // record only (traces are replayed in the simulator)
+#endif // INPUT_TRACE_ENABLED
+
+  log(CLASS_PLATFORM, Debug, "Setup RTC");
+  rtcState.setup(readRtcCustom, writeRtc);
+  if (now() < rtcState.expectedTime()) { // clock reset by deep sleep
+    setTime(rtcState.expectedTime());
+  }
 
   log(CLASS_PLATFORM, Debug, "Setup cmds");
-  cmdBuffer = new Buffer(COMMAND_MAX_LENGTH);
-  cmdLast = new Buffer(COMMAND_MAX_LENGTH);
+  lineEditor.setup(serialEcho);
 
   log(CLASS_PLATFORM, Debug, "Setup timing");
-  setExternalMillis(millis);
+  setExternalMillisCustom(millis);
+  energyMeter.setCpuMhz(ESP.getCpuFreqMHz());
+  memoryMeter.setup(heapFree, heapMaxBlock, stackFree);
 
   heartbeat();
 
+  phaseTimer.begin(PhaseStartup);
   startup(
     PROJECT_ID,
     STRINGIFY(PROJ_VERSION),
@@ -253,6 +285,7 @@ void setupArchitecture() {
     cleanFailures,
     restoreSafeFirmware
   );
+  phaseTimer.end(PhaseStartup);
 
   log(CLASS_PLATFORM, Debug, "Setup pins");
   pinMode(POWER_PIN, OUTPUT);
@@ -267,8 +300,11 @@ void setupArchitecture() {
   heartbeat();
   log(CLASS_PLATFORM, Debug, "Setup LCD");
 #ifdef LCD_ENABLED
-  lcd = new Adafruit_PCD8544(LCD_CLK_PIN, LCD_DIN_PIN, LCD_DC_PIN, LCD_CS_PIN, LCD_RST_PIN);
+  phaseTimer.begin(PhaseLcd);
+  lcd = arena.make<Pcd8544Display>(LCD_CLK_PIN, LCD_DIN_PIN, LCD_DC_PIN, LCD_CS_PIN, LCD_RST_PIN);
   lcd->begin(lcdContrast(), LCD_DEFAULT_BIAS);
+  energyMeter.switchOn(EnergyLcd);
+  phaseTimer.end(PhaseLcd);
 #endif // LCD_ENABLED
   delay(DELAY_MS_SPI);
 
@@ -279,6 +315,7 @@ void setupArchitecture() {
   log(CLASS_PLATFORM, Debug, "Setup commands");
 #ifdef TELNET_ENABLED
   telnet.setCallBackProjectCmds(reactCommandCustom);
+  telnetSink.setup(telnetWrite);
   String helpCli("Type 'help' for help");
   telnet.setHelpProjectsCmds(helpCli);
 #endif // TELNET_ENABLED
@@ -287,13 +324,14 @@ void setupArchitecture() {
 }
 
 void runModeArchitecture() {
-  Buffer timeAux(32);
+  static Buffer timeAux(32); // allocated once (not upon every loop)
   Timing::humanize(m->getClock()->currentTime(), &timeAux);
   timeAux.replace(' ', '\n');
 
-  Buffer lcdAux(200);
+  static Buffer lcdAux(200);
 
-  lcdAux.fill("%s\nVcc: %0.4f\nV:%s\n", timeAux.getBuffer(), VCC_FLOAT, STRINGIFY(PROJ_VERSION));
+  int mv = vccMillivoltsCustom();
+  lcdAux.fill("%s\nVcc: %d.%03d\nV:%s\n", timeAux.getBuffer(), mv / 1000, mv % 1000, STRINGIFY(PROJ_VERSION));
   logRaw(CLASS_PLATFORM, Debug, lcdAux.getBuffer());
 
   messageFunc(0, 0, 1, false, FullClear, 1, lcdAux.getBuffer());
@@ -305,75 +343,113 @@ void runModeArchitecture() {
 }
 
 CmdExecStatus commandArchitecture(const char *c) {
-  if (strcmp("init", c) == 0) {
-    logRaw(CLASS_PLATFORM, User, "-> Initialize");
-    logRaw(CLASS_PLATFORM, User, "Execute:");
-    logRaw(CLASS_PLATFORM, User, "   ls");
-    log(CLASS_PLATFORM, User, "   save %s <alias>", DEVICE_ALIAS_FILENAME);
-    log(CLASS_PLATFORM, User, "   save %s <pwd>", DEVICE_PWD_FILENAME);
-    logRaw(CLASS_PLATFORM, User, "   wifissid <ssid>");
-    logRaw(CLASS_PLATFORM, User, "   wifipass <password>");
-    log(CLASS_PLATFORM, User, "   save %s <contrast-0-100>", DEVICE_CONTRAST_FILENAME);
-    logRaw(CLASS_PLATFORM, User, "   (setup of power consumption settings architecture specific if any)");
-    logRaw(CLASS_PLATFORM, User, "   store");
-    logRaw(CLASS_PLATFORM, User, "   ls");
-    return Executed;
-  } else if (strcmp("ls", c) == 0) {
-    SPIFFS.begin();
-    Dir dir = SPIFFS.openDir("/");
-    while (dir.next()) {
-      log(CLASS_PLATFORM, User, "- %s (%d bytes)", dir.fileName().c_str(), (int)dir.fileSize());
-    }
-    SPIFFS.end();
-    return Executed;
-  } else if (strcmp("rm", c) == 0) {
-    const char *f = strtok(NULL, " ");
-    SPIFFS.begin();
-    bool succ = SPIFFS.remove(f);
-    log(CLASS_PLATFORM, User, "### File '%s' %s removed", f, (succ ? "" : "NOT"));
-    SPIFFS.end();
-    return Executed;
-  } else if (strcmp("lcdcont", c) == 0) {
-    const char *c = strtok(NULL, " ");
-    int i = atoi(c);
-    log(CLASS_PLATFORM, User, "Set contrast to: %d", i);
-    //lcd->setContrast(i);
-    return Executed;
-  } else if (strcmp("reset", c) == 0) {
-    ESP.restart(); // it is normal that it fails if invoked the first time after firmware is written
-    return Executed;
-  } else if (strcmp("freq", c) == 0) {
-    uint8 fmhz = (uint8)atoi(strtok(NULL, " "));
-    bool succ = system_update_cpu_freq(fmhz);
-    log(CLASS_PLATFORM, User, "Freq updated: %dMHz (succ %s)", (int)fmhz, BOOL(succ));
-    return Executed;
-  } else if (strcmp("deepsleep", c) == 0) {
-    int s = atoi(strtok(NULL, " "));
-    deepSleepNotInterruptableSecs(now(), s);
-    return Executed;
-  } else if (strcmp("lightsleep", c) == 0) {
-    int s = atoi(strtok(NULL, " "));
-    return (sleepInterruptable(now(), s) ? ExecutedInterrupt : Executed);
-  } else if (strcmp("clearstack", c) == 0) {
-    espSaveCrash.clear();
-    return Executed;
-  } else if (strcmp("help", c) == 0 || strcmp("?", c) == 0) {
-    logRaw(CLASS_PLATFORM, User, HELP_COMMAND_ARCH_CLI);
-    return Executed;
-  } else {
-    return NotFound;
+  switch (commandHash(c)) {
+    case commandHash("init"):
+      if (commandIs(c, "init")) {
+        logRaw(CLASS_PLATFORM, User, "-> Initialize");
+        logRaw(CLASS_PLATFORM, User, "Execute:");
+        logRaw(CLASS_PLATFORM, User, "   ls");
+        log(CLASS_PLATFORM, User, "   save %s <alias>", DEVICE_ALIAS_FILENAME);
+        log(CLASS_PLATFORM, User, "   save %s <pwd>", DEVICE_PWD_FILENAME);
+        logRaw(CLASS_PLATFORM, User, "   wifissid <ssid>");
+        logRaw(CLASS_PLATFORM, User, "   wifipass <password>");
+        log(CLASS_PLATFORM, User, "   save %s <contrast-0-100>", DEVICE_CONTRAST_FILENAME);
+        logRaw(CLASS_PLATFORM, User, "   (setup of power consumption settings architecture specific if any)");
+        logRaw(CLASS_PLATFORM, User, "   store");
+        logRaw(CLASS_PLATFORM, User, "   ls");
+        return Executed;
+      }
+      break;
+    case commandHash("ls"):
+      if (commandIs(c, "ls")) {
+        SPIFFS.begin();
+        Dir dir = SPIFFS.openDir("/");
+        while (dir.next()) {
+          log(CLASS_PLATFORM, User, "- %s (%d bytes)", dir.fileName().c_str(), (int)dir.fileSize());
+        }
+        SPIFFS.end();
+        return Executed;
+      }
+      break;
+    case commandHash("rm"):
+      if (commandIs(c, "rm")) {
+        const char *f = strtok(NULL, " ");
+        SPIFFS.begin();
+        bool succ = (TuningStore::isTuning(f) ? removeTuning(f) : SPIFFS.remove(f));
+        log(CLASS_PLATFORM, User, "### File '%s' %s removed", f, (succ ? "" : "NOT"));
+        SPIFFS.end();
+        return Executed;
+      }
+      break;
+    case commandHash("lcdcont"):
+      if (commandIs(c, "lcdcont")) {
+        const char *c = strtok(NULL, " ");
+        int i = atoi(c);
+        log(CLASS_PLATFORM, User, "Set contrast to: %d", i);
+        //lcd->setContrast(i);
+        return Executed;
+      }
+      break;
+    case commandHash("reset"):
+      if (commandIs(c, "reset")) {
+        ESP.restart(); // it is normal that it fails if invoked the first time after firmware is written
+        return Executed;
+      }
+      break;
+    case commandHash("freq"):
+      if (commandIs(c, "freq")) {
+        uint8 fmhz = (uint8)atoi(strtok(NULL, " "));
+        bool succ = system_update_cpu_freq(fmhz);
+        if (succ) {
+          energyMeter.setCpuMhz(fmhz);
+        }
+        log(CLASS_PLATFORM, User, "Freq updated: %dMHz (succ %s)", (int)fmhz, BOOL(succ));
+        return Executed;
+      }
+      break;
+    case commandHash("deepsleep"):
+      if (commandIs(c, "deepsleep")) {
+        int s = atoi(strtok(NULL, " "));
+        deepSleepNotInterruptableSecs(now(), s);
+        return Executed;
+      }
+      break;
+    case commandHash("lightsleep"):
+      if (commandIs(c, "lightsleep")) {
+        int s = atoi(strtok(NULL, " "));
+        return (sleepInterruptable(now(), s) ? ExecutedInterrupt : Executed);
+      }
+      break;
+    case commandHash("clearstack"):
+      if (commandIs(c, "clearstack")) {
+        espSaveCrash.clear();
+        return Executed;
+      }
+      break;
+    case commandHash("help"):
+    case commandHash("?"):
+      if (commandIs(c, "help") || commandIs(c, "?")) {
+        logRaw(CLASS_PLATFORM, User, HELP_COMMAND_ARCH_CLI);
+        return Executed;
+      }
+      break;
+    default:
+      break;
   }
+  return NotFound;
+}
+
+bool readRtc(void *data, int length) {
+  return ESP.rtcUserMemoryRead(RTC_STATE_OFFSET_BLOCKS, (uint32_t*) data, length);
+}
+
+bool writeRtc(const void *data, int length) {
+  return ESP.rtcUserMemoryWrite(RTC_STATE_OFFSET_BLOCKS, (uint32_t*) data, length);
 }
 
 int readRemainingSecs() {
-  int s;
-  if (ESP.rtcUserMemoryRead(0, (uint32_t*) &rtcData, sizeof(rtcData))) {
-    if (rtcData.crc32 == 0) {
-      return rtcData.remainingSecs;
-    } else {
-      log(CLASS_PLATFORM, Warn, "Invalid RTC");
-      return -1;
-    }
+  if (rtcState.isValid()) {
+    return rtcState.getData()->remainingSecs;
   } else {
     log(CLASS_PLATFORM, Debug, "No ds remaining");
     return -1;
@@ -381,11 +457,8 @@ int readRemainingSecs() {
 }
 
 void writeRemainingSecs(int s) {
-  rtcData.crc32 = 0;
-  rtcData.remainingSecs = s;
-  if (!ESP.rtcUserMemoryWrite(0, (uint32_t*) &rtcData, sizeof(rtcData))) {
-    log(CLASS_PLATFORM, Warn, "Failed to write remaining");
-  }
+  rtcState.getData()->remainingSecs = s;
+  rtcState.save();
 }
 
 ////////////////////////////////////////
@@ -396,33 +469,13 @@ void debugHandle() {
   if (!m->getModuleSettings()->getDebug()) {
     return;
   }
-  static bool firstTime = true;
   Serial.setDebugOutput(m->getModuleSettings()->getDebug()); // deep HW logs
-  if (firstTime) {
-    log(CLASS_PLATFORM, Debug, "Initialize debuggers...");
-#ifdef TELNET_ENABLED
-    telnet.begin(apiDeviceLogin()); // Intialize the remote logging framework
-#endif // TELNET_ENABLED
-#ifdef OTA_ENABLED
-    ArduinoOTA.begin();             // Intialize OTA
-#endif // OTA_ENABLED
-    firstTime = false;
-  }
+  debugStart(); // serviced from then on by the heartbeat (loop, light sleeps, HTTP requests)
 
-  //m->getSleepinoSettings()->getStatus()->fill("freeheap:%d", ESP.getFreeHeap()); // made crash, reenable upon upgrade
-  m->getSleepinoSettings()->getStatus()->fill("vcc:%0.2f", VCC_FLOAT);
-  m->getSleepinoSettings()->getMetadata()->changed();
+  m->getSleepinoSettings()->getStatus()->fill("vcc:%dmV dbg:%lums tdrop:%ld ldrop:%ld", vccMillivoltsCustom(), debugServiceMaxMs, TELNET_DROPPED, logRing.getDropped());
+  m->getSleepinoSettings()->changedProp(SleepinoSettingsStatusProp);
 
-#ifdef TELNET_ENABLED
-  log(CLASS_PLATFORM, User, "telnet?");
-  for (int i = 0; i < TELNET_HANDLE_DELAY_MS/1000; i++) {
-    telnet.handle();     // Handle telnet log server and commands
-    delay(1000);
-  }
-#endif // TELNET_ENABLED
-#ifdef OTA_ENABLED
-  ArduinoOTA.handle(); // Handle on the air firmware load
-#endif // OTA_ENABLED
+  debugService();
 }
 
 
@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <iostream>
+#include <new>
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
@@ -7,6 +8,8 @@
 #include <primitives/BoardX86_64.h>
 
 #define MAX_SLEEP_CYCLE_SECS 3600 // 1 hour
+#define SERVO_SETTLE_MIN_MS 0 // no servo to wait for
+#define SERVO_SETTLE_MS_PER_DEGREE 0
 
 #ifndef SIMULATOR_LOGIN
 #error "Must define SIMULATOR_LOGIN"
@@ -17,12 +20,154 @@
 #endif // SIMULATOR_PASS
 
 #define CL_MAX_LENGTH 65000
+#define RTC_FILENAME ".simulator.rtc" // emulation of the RTC memory
+#define BENCH_VCC_SAMPLES 1000000
 #define HTTP_CODE_KEY "HTTP_CODE:"
 #define CURL_COMMAND_GET "/usr/bin/curl --silent -w '" HTTP_CODE_KEY "%%{http_code}' -XGET '%s'"
 #define CURL_COMMAND_POST "/usr/bin/curl --silent -w '" HTTP_CODE_KEY "%%{http_code}' -XPOST '%s' -d '%s'"
 
 enum AppMode { Interactive = 0, NonInteractive = 1 };
-AppMode appMode = Interactive;
+
+#ifdef ALLOC_COUNTING_ENABLED
+
+// Instrumented allocator: every allocation (malloc family and operator new) is counted
+// (glibc only, the real allocator is reached through its internal entry points).
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+extern "C" void *malloc(size_t size) {
+  allocCounter.allocated(size);
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+  allocCounter.allocated(n * size);
+  return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) {
+  allocCounter.allocated(size);
+  return __libc_realloc(p, size);
+}
+
+void *operator new(size_t size) {
+  void *p = malloc(size);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+#endif // ALLOC_COUNTING_ENABLED
+
+// State of the simulated device. A process simulates a single device, as the libraries
+// (logs, clock, timing) keep their state in globals: see ./fleet to simulate many of them.
+struct {
+  AppMode appMode;
+  const char *login; // device login (SIMULATOR_LOGIN environment variable, or build flag)
+  const char *pass;  // device password (SIMULATOR_PASS environment variable, or build flag)
+  time_t epoch;      // time at which the device starts (SIMULATOR_EPOCH environment variable, 0 for the current time)
+  FILE *record;      // trace of the inputs being recorded (SIMULATOR_RECORD environment variable)
+  FILE *replay;      // trace of the inputs being replayed (SIMULATOR_REPLAY environment variable)
+  bool resume;       // keep the RTC memory of the previous run, as after a deep sleep (SIMULATOR_RESUME environment variable)
+} simulator = {Interactive, SIMULATOR_LOGIN, SIMULATOR_PASS, 0, NULL, NULL, false};
+
+Buffer simulatorCommand(INPUT_TRACE_LINE_LENGTH); // command being executed (allocated once, not per loop)
+
+void simulatorTraceWrite(const char *line) {
+  ALLOC_SCOPE(AllocEmulation);
+  fputs(line, simulator.record);
+  fflush(simulator.record);
+}
+
+bool simulatorTraceRead(char *line, int length) {
+  ALLOC_SCOPE(AllocEmulation);
+  return fgets(line, length, simulator.replay) != NULL;
+}
+
+void simulatorEnvironment() {
+  const char *login = getenv("SIMULATOR_LOGIN");
+  const char *pass = getenv("SIMULATOR_PASS");
+  const char *epoch = getenv("SIMULATOR_EPOCH");
+  const char *record = getenv("SIMULATOR_RECORD");
+  const char *replay = getenv("SIMULATOR_REPLAY");
+  const char *resume = getenv("SIMULATOR_RESUME");
+  simulator.login = (login != NULL ? login : simulator.login);
+  simulator.pass = (pass != NULL ? pass : simulator.pass);
+  simulator.epoch = (epoch != NULL ? (time_t)atol(epoch) : simulator.epoch);
+  simulator.record = (record != NULL ? fopen(record, "w") : NULL);
+  simulator.replay = (replay != NULL ? fopen(replay, "r") : NULL);
+  simulator.resume = (resume != NULL && strcmp(resume, "0") != 0);
+  if (!simulator.resume) { // every run starts as after a power on
+    remove(RTC_FILENAME);
+  }
+  inputTrace.setup(simulator.record != NULL ? simulatorTraceWrite : NULL, simulator.replay != NULL ? simulatorTraceRead : NULL);
+}
+
+#ifdef VIRTUAL_CLOCK_ENABLED
+
+// Virtual clock: sleeps advance the simulated time instantly instead of blocking,
+// so that long horizons of wake cycles (days, months) can be simulated in seconds.
+
+struct {
+  unsigned long offsetMs; // amount of simulated time added to the real clock
+  long lightSleeps;
+  long deepSleeps;
+  time_t sleptSecs;
+} virtualClock = {0, 0, 0, 0};
+
+unsigned long virtualMillis() {
+  return millis() + virtualClock.offsetMs;
+}
+
+void virtualClockAdvance(time_t secs) {
+  if (secs <= 0) {
+    return;
+  }
+  virtualClock.offsetMs += (unsigned long)secs * 1000;
+  virtualClock.sleptSecs += secs;
+  adjustTime(secs);
+}
+
+bool virtualLightSleepInterruptable(time_t cycleBegin, time_t periodSecs, int miniPeriodMsec, bool (*interrupt)(), void (*heartbeat)()) {
+  virtualClock.lightSleeps++;
+  heartbeat();
+  if (interrupt()) {
+    return true;
+  }
+  virtualClockAdvance(cycleBegin + periodSecs - now());
+  return false;
+}
+
+void virtualDeepSleepNotInterruptable(time_t cycleBegin, time_t periodSecs) {
+  virtualClock.deepSleeps++;
+  virtualClockAdvance(periodSecs);
+}
+
+void virtualClockReport(int steps) {
+  log(CLASS_PLATFORM, Info, "### Virtual clock: steps=%d ls=%ld ds=%ld slept=%lds (%ldd)",
+      steps, virtualClock.lightSleeps, virtualClock.deepSleeps, (long)virtualClock.sleptSecs, (long)virtualClock.sleptSecs / 86400);
+}
+
+// Redirect the board sleep primitives (used by the generic Platform functions) to the virtual ones.
+#define lightSleepInterruptable virtualLightSleepInterruptable
+#define deepSleepNotInterruptable virtualDeepSleepNotInterruptable
+
+#endif // VIRTUAL_CLOCK_ENABLED
 
 
 ////////////////////////////////////////
@@ -40,22 +185,78 @@ void writeRemainingSecs(int s) {
   return; // not supported
 }
 
-float vcc() {
-  return 3.3; // not supported
+bool initializeWifiFast(const char *ssid, const char *pass, const char *ssidb, const char *passb) {
+  return false; // no radio, regular connection is immediate
+}
+
+void cacheWifi() {
+  return; // not supported
+}
+
+bool readRtc(void *data, int length) {
+  ALLOC_SCOPE(AllocEmulation);
+  FILE *f = fopen(RTC_FILENAME, "rb");
+  if (f == NULL) {
+    return false;
+  }
+  bool succ = (fread(data, 1, length, f) == (size_t)length);
+  fclose(f);
+  return succ;
+}
+
+bool writeRtc(const void *data, int length) {
+  ALLOC_SCOPE(AllocEmulation);
+  FILE *f = fopen(RTC_FILENAME, "wb");
+  if (f == NULL) {
+    return false;
+  }
+  bool succ = (fwrite(data, 1, length, f) == (size_t)length);
+  fclose(f);
+  return succ;
+}
+
+void displayFlush() {
+  return; // no display
+}
+
+int vccMillivolts() {
+  return 3300; // not supported
 }
 
 const char *apiDeviceLogin() {
-  return SIMULATOR_LOGIN;
+  return simulator.login;
 }
 
 const char *apiDevicePass() {
-  return SIMULATOR_PASS;
+  return simulator.pass;
 }
 
 void logLine(const char *str) {
+  ALLOC_SCOPE(AllocLog);
   printf("LOG: %s", str);
 }
 
+#ifdef LOG_DEFERRED_ENABLED
+// Encode and decode right away (exercises the decoder used on the host for the logs of the devices).
+void logDeferred(const char *clz, int level, int id, ...) {
+#ifdef LOG_LEVEL
+  if (level < LOG_LEVEL) { // same filter as log
+    return;
+  }
+#endif // LOG_LEVEL
+  char rec[LOG_DEFERRED_MAX_LENGTH];
+  char line[MAX_LOG_MSG_LENGTH];
+  va_list args;
+  va_start(args, id);
+  int n = logEncodeRecord(rec, sizeof(rec) - 1, clz, level, id, args);
+  va_end(args);
+  rec[n] = 0;
+  if (logDecodeRecord(rec, line, sizeof(line))) {
+    printf("LOG: %s (%s)\n", line, rec);
+  }
+}
+#endif // LOG_DEFERRED_ENABLED
+
 void messageFunc(int x, int y, int color, bool wrap, MsgClearMode clear, int size, const char *str) {
   printf("\n\n***** LCD (size %d)\n  %s\n*****\n\n", size, str);
 }
@@ -76,36 +277,112 @@ void io(int pin, int val) { }
 // Execution
 ///////////////////
 
-void heartbeat() {}
+void heartbeat() {
+  servoMotion.tick();
+  memoryMeter.sample();
+}
+
+unsigned long microsArchitecture() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (unsigned long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
 
 bool haveToInterrupt() {
   return false;
 }
 
 void setupArchitecture() {
+  log(CLASS_PLATFORM, Debug, "Setup RTC");
+  rtcState.setup(readRtcCustom, writeRtc);
+  log(CLASS_PLATFORM, Debug, "RTC wakes: %lu", (unsigned long)rtcState.getData()->wakes);
+  if (simulator.epoch > 0 && now() < simulator.epoch) { // common start of the devices of a fleet
+    setTime(simulator.epoch);
+  }
+  if (now() < rtcState.expectedTime()) { // resume the clock of the previous run as after a deep sleep
+    setTime(rtcState.expectedTime());
+  }
+
   log(CLASS_PLATFORM, Debug, "Setup timing");
-  setExternalMillis(millis);
+  memoryMeter.setup(NULL, NULL, memoryStackUnused); // heap figures not meaningful in the simulator
+#ifdef VIRTUAL_CLOCK_ENABLED
+  setExternalMillisCustom(virtualMillis);
+#else // VIRTUAL_CLOCK_ENABLED
+  setExternalMillisCustom(millis);
+#endif // VIRTUAL_CLOCK_ENABLED
 }
 
 void runModeArchitecture() {
-  if (appMode == Interactive) {
-    char str[100];
+  ALLOC_SCOPE(AllocRun);
+  if (inputTrace.isReplaying()) { // commands come from the trace instead of the standard input
+    while (inputTrace.replayCommand(&simulatorCommand)) {
+      m->command(simulatorCommand.getBuffer());
+    }
+  } else if (simulator.appMode == Interactive) {
     printf("Waiting for input: \n   ");
-    fgets(str, 100, stdin);
-    if (strlen(str) != 0) {
-      Buffer cmdBuffer(str);
-      cmdBuffer.replace('\n', 0);
-      cmdBuffer.replace('\r', 0);
-      m->command(cmdBuffer.getBuffer());
+    simulatorCommand.clear();
+    if (fgets(simulatorCommand.getUnsafeBuffer(), INPUT_TRACE_LINE_LENGTH, stdin) != NULL && !simulatorCommand.isEmpty()) {
+      simulatorCommand.replace('\n', 0);
+      simulatorCommand.replace('\r', 0);
+      inputTrace.recordCommand(simulatorCommand.getBuffer());
+      m->command(simulatorCommand.getBuffer());
     }
   }
 }
 
+// Compare the former floating point Vcc pipeline with the fixed point one (ns per sample).
+void benchVcc(long n) {
+  volatile int sink = 0;
+  int mvMin = 3000;
+  int mvMax = 3600;
+
+  unsigned long start = microsArchitecture();
+  float filtered = 0;
+  for (long i = 0; i < n; i++) {
+    float v = (float)(3100 + (i & 255)) / 1024 * 1000 / 1000;
+    filtered = (filtered == 0 ? v : filtered + (v - filtered) / 4);
+    int mv = filtered * 1000;
+    float charge = ((float)(mv - mvMin) / (mvMax - mvMin)) * 100;
+    sink = sink + (int)charge;
+  }
+  unsigned long floatUs = microsArchitecture() - start;
+
+  start = microsArchitecture();
+  int32_t filteredQ8 = 0;
+  for (long i = 0; i < n; i++) {
+    int mv = (int)(((long)(3100 + (i & 255)) * 1000) >> 10);
+    filteredQ8 = Battery::filterQ8(filteredQ8, mv);
+    int charge = Battery::chargePercentage((filteredQ8 + 128) >> 8, mvMin, mvMax);
+    sink = sink + charge;
+  }
+  unsigned long fixedUs = microsArchitecture() - start;
+
+  log(CLASS_PLATFORM, User, "### Vcc bench (%ld samples, ns/sample): float=%ld fixed=%ld", n, (long)(floatUs * 1000 / n), (long)(fixedUs * 1000 / n));
+}
+
 CmdExecStatus commandArchitecture(const char *c) {
+  ALLOC_SCOPE(AllocCommand);
+  switch (commandHash(c)) {
+    case commandHash("benchvcc"):
+      if (commandIs(c, "benchvcc")) {
+        const char *n = strtok(NULL, " ");
+        long samples = (n == NULL ? BENCH_VCC_SAMPLES : atol(n));
+        if (samples <= 0) {
+          logRaw(CLASS_PLATFORM, Warn, "Arguments needed:\n  benchvcc [samples > 0]");
+          return InvalidArgs;
+        }
+        benchVcc(samples);
+        return Executed;
+      }
+      break;
+    default:
+      break;
+  }
   return NotFound;
 }
 
 void configureModeArchitecture() {
+  ALLOC_SCOPE(AllocRun);
   // nothing to be done here
 }
 
@@ -120,27 +397,73 @@ void abort(const char *msg) {
 void setup();
 void loop();
 
+#ifdef BENCHMARK_ENABLED
+#include <Benchmark.h>
+#endif // BENCHMARK_ENABLED
+
+// Single line summary of the run (parsed by ./fleet).
+void simulatorSummary(int steps) {
+#ifdef VIRTUAL_CLOCK_ENABLED
+  long slept = (long)virtualClock.sleptSecs;
+#else // VIRTUAL_CLOCK_ENABLED
+  long slept = 0;
+#endif // VIRTUAL_CLOCK_ENABLED
+  printf("FLEET login=%s steps=%d wakes=%ld wasted=%ld requests=%ld awake_ms=%llu slept_s=%ld\n",
+         simulator.login, steps, scheduler.getWakes(), scheduler.getWasted(), phaseTimer.getEntries(PhaseSync),
+         phaseTimer.getAwakeUs() / 1000, slept);
+}
+
 int main(int argc, const char *argv[]) {
+  memoryStackPaint();
+  simulatorEnvironment();
   setup();
 
   int simulationSteps = 10;
 
   if (argc == 1) {
-    appMode = NonInteractive;
+    simulator.appMode = NonInteractive;
   } else if (argc == 1 + 1) {
-    appMode = (AppMode)atoi(argv[1]);
+    simulator.appMode = (AppMode)atoi(argv[1]);
   } else if (argc == 1 + 2) {
-    appMode = (AppMode)atoi(argv[1]);
+    simulator.appMode = (AppMode)atoi(argv[1]);
     simulationSteps = atoi(argv[2]);
   } else if (argc != 1 + 2) {
     log(CLASS_PLATFORM, Error, "2 args max: <starter> [appMode [steps]]");
     return -1;
   }
 
+#ifdef BENCHMARK_ENABLED
+  benchmarkSuite();
+  return 0;
+#endif // BENCHMARK_ENABLED
+
   for (int i = 0; i < simulationSteps; i++) {
     log(CLASS_PLATFORM, Debug, "### Step %d/%d", i, simulationSteps);
+    allocCounter.beginLoop();
     loop();
+    allocCounter.endLoop();
+  }
+#ifdef VIRTUAL_CLOCK_ENABLED
+  virtualClockReport(simulationSteps);
+#endif // VIRTUAL_CLOCK_ENABLED
+  phaseTimer.report();
+  energyMeter.report();
+  scheduler.report();
+  simulatorSummary(simulationSteps);
+  inputTrace.report();
+  if (simulator.record != NULL) {
+    fclose(simulator.record);
+  }
+  if (simulator.replay != NULL) {
+    fclose(simulator.replay);
+  }
+#ifdef ALLOC_COUNTING_ENABLED
+  allocCounter.report();
+  if (allocCounter.getOverBudget() > 0) {
+    log(CLASS_PLATFORM, Error, "### FAILED: allocation budget exceeded");
+    return 1;
   }
+#endif // ALLOC_COUNTING_ENABLED
   log(CLASS_PLATFORM, Debug, "### DONE");
   return 0;
 }
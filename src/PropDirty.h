@@ -0,0 +1,100 @@
+#ifndef PROP_DIRTY_INC
+#define PROP_DIRTY_INC
+
+#include <stdint.h>
+#include <main4ino/Actor.h>
+
+#define PROP_DIRTY_MAX_PROPS 32 // props per actor that can be tracked
+
+/**
+ * Per-property dirty tracking of an actor (bitmask, one bit per prop index).
+ *
+ * Lets an actor flag its metadata as changed only when a prop actually changed (or moved
+ * beyond a threshold, for numeric status props), and tells which props did since the last
+ * successful synchronization. The masks are only used for debug logging so far: the
+ * synchronization still sends every prop of a changed actor.
+ */
+class PropDirty {
+
+private:
+  uint32_t mask;
+
+public:
+  PropDirty() {
+    mask = 0;
+  }
+
+  void mark(int prop) {
+    if (prop >= 0 && prop < PROP_DIRTY_MAX_PROPS) {
+      mask |= ((uint32_t)1 << prop);
+    }
+  }
+
+  bool isDirty(int prop) {
+    return prop >= 0 && prop < PROP_DIRTY_MAX_PROPS && (mask & ((uint32_t)1 << prop)) != 0;
+  }
+
+  bool any() {
+    return mask != 0;
+  }
+
+  uint32_t getMask() {
+    return mask;
+  }
+
+  void clear() {
+    mask = 0;
+  }
+
+  /**
+   * Update a numeric prop with a new value only if it moved at least by the threshold
+   * (so that noise is not reported), returns true (and marks the prop) if updated.
+   */
+  bool update(int prop, int *v, int value, int threshold) {
+    int delta = (value > *v ? value - *v : *v - value);
+    if (delta == 0 || delta < threshold) {
+      return false;
+    }
+    *v = value;
+    mark(prop);
+    return true;
+  }
+};
+
+/**
+ * Same as setPropInteger, returns true if the value was changed.
+ */
+inline bool setPropIntegerTracked(GetSetMode m, const Value *targetValue, Value *actualValue, int *v) {
+  int before = *v;
+  setPropInteger(m, targetValue, actualValue, v);
+  return *v != before;
+}
+
+/**
+ * Same as setPropBoolean, returns true if the value was changed.
+ */
+inline bool setPropBooleanTracked(GetSetMode m, const Value *targetValue, Value *actualValue, bool *v) {
+  bool before = *v;
+  setPropBoolean(m, targetValue, actualValue, v);
+  return *v != before;
+}
+
+/**
+ * Same as setPropValue, returns true if the value was changed.
+ */
+inline bool setPropValueTracked(GetSetMode m, const Value *targetValue, Value *actualValue, Buffer *v) {
+  bool changes = (m != GetValue && targetValue != NULL && !v->equals(targetValue->getBuffer()));
+  setPropValue(m, targetValue, actualValue, v);
+  return changes;
+}
+
+/**
+ * Same as setPropTiming, returns true if the frequency was changed.
+ */
+inline bool setPropTimingTracked(GetSetMode m, const Value *targetValue, Value *actualValue, Timing *v) {
+  bool changes = (m != GetValue && targetValue != NULL && !targetValue->equals(v->getFreq()));
+  setPropTiming(m, targetValue, actualValue, v);
+  return changes;
+}
+
+#endif // PROP_DIRTY_INC
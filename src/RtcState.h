@@ -0,0 +1,201 @@
+#ifndef RTC_STATE_INC
+#define RTC_STATE_INC
+
+#include <log4ino/Log.h>
+#include <EnergyMeter.h>
+#include <PhaseTimer.h>
+#include <SampleBatch.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CLASS_RTC_STATE "RT"
+
+#define RTC_STATE_VERSION 7
+
+#define RTC_TUNING_SLOTS 3
+#define RTC_TUNING_VALUE_MAX_LENGTH 20
+
+struct RtcTuning {
+  uint32_t key; // crc32 of the tuning filename (0 if slot free)
+  char value[RTC_TUNING_VALUE_MAX_LENGTH]; // in plaintext (secret variables are never cached)
+};
+
+struct RtcWifi {
+  uint32_t ssid;     // crc32 of the ssid of the access point (0 if nothing cached)
+  uint8_t bssid[6];  // MAC of the access point
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t ip;       // DHCP lease
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t leaseTime; // time at which the lease was obtained
+  uint32_t connectMs; // latency of the last connection
+};
+
+/**
+ * Block of state that survives deep sleep (RTC memory).
+ * Any change of layout requires a bump of RTC_STATE_VERSION.
+ */
+struct RtcStateData {
+  uint32_t crc32;    // crc32 of the block (excluding this field)
+  uint16_t version;  // RTC_STATE_VERSION
+  uint16_t length;   // size of the block
+  int32_t remainingSecs; // extended deep sleep remaining seconds
+  uint32_t wakes;        // amount of boots since the block was initialized
+  uint32_t sleepTime;    // time at which the device went to deep sleep (0 if unknown)
+  uint32_t sleepSecs;    // duration of such deep sleep
+  uint32_t syncTime;     // time of the last properties synchronization (0 if unknown)
+  int32_t syncCode;      // result of the last properties synchronization
+  RtcTuning tunings[RTC_TUNING_SLOTS];
+  RtcWifi wifi;          // last good wifi connection (for fast reconnect)
+  SampleBatchData vccs;  // Vcc samples not uploaded yet
+  int32_t vccFilteredQ8; // filtered Vcc [mV] in Q8 fixed point (0 if no sample yet)
+  EnergyMeterData energy; // figures of the last wake cycle
+  PhaseTimerData phases;  // phases of the last wake cycle
+};
+
+uint32_t rtcCrc32(const uint8_t *data, int length, uint32_t crc = 0) {
+  crc = ~crc;
+  for (int i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+/**
+ * Versioned and CRC-validated persistent state block.
+ *
+ * Reading and writing of the actual RTC memory is provided by the platform.
+ */
+class RtcState {
+
+private:
+  RtcStateData data;
+  bool valid;
+  bool (*reader)(void *data, int length);
+  bool (*writer)(const void *data, int length);
+
+  uint32_t computeCrc() {
+    return rtcCrc32((const uint8_t *)&data + sizeof(data.crc32), sizeof(data) - sizeof(data.crc32));
+  }
+
+  void reset() {
+    memset(&data, 0, sizeof(data));
+    data.version = RTC_STATE_VERSION;
+    data.length = sizeof(data);
+  }
+
+  RtcTuning *findTuning(uint32_t key) {
+    for (int i = 0; i < RTC_TUNING_SLOTS; i++) {
+      if (data.tunings[i].key == key) {
+        return &data.tunings[i];
+      }
+    }
+    return NULL;
+  }
+
+public:
+  RtcState() {
+    reset();
+    valid = false;
+    reader = NULL;
+    writer = NULL;
+  }
+
+  /**
+   * Load the block (reinitialize it if invalid).
+   */
+  void setup(bool (*r)(void *data, int length), bool (*w)(const void *data, int length)) {
+    reader = r;
+    writer = w;
+    valid = reader(&data, sizeof(data)) && data.version == RTC_STATE_VERSION && data.length == sizeof(data) && data.crc32 == computeCrc();
+    if (!valid) {
+      log(CLASS_RTC_STATE, Warn, "Invalid RTC");
+      reset();
+    }
+    data.wakes++;
+  }
+
+  bool save() {
+    if (writer == NULL) {
+      return false;
+    }
+    data.crc32 = computeCrc();
+    bool succ = writer(&data, sizeof(data));
+    if (!succ) {
+      log(CLASS_RTC_STATE, Warn, "Failed to write RTC");
+    }
+    return succ;
+  }
+
+  /**
+   * Whether the block was loaded successfully from the RTC memory (timer wake),
+   * as opposed to initialized (power on / reset / layout change).
+   */
+  bool isValid() {
+    return valid;
+  }
+
+  RtcStateData *getData() {
+    return &data;
+  }
+
+  /**
+   * Cached value of a tuning variable (NULL if not cached).
+   */
+  const char *getTuning(const char *filename) {
+    RtcTuning *t = findTuning(rtcCrc32((const uint8_t *)filename, strlen(filename)));
+    return (t == NULL ? NULL : t->value);
+  }
+
+  /**
+   * Cache the value of a tuning variable (not cached if too long or no slots left).
+   */
+  void setTuning(const char *filename, const char *value) {
+    uint32_t key = rtcCrc32((const uint8_t *)filename, strlen(filename));
+    if (strlen(value) >= RTC_TUNING_VALUE_MAX_LENGTH) {
+      clearTuning(filename); // no stale value left behind
+      return;
+    }
+    RtcTuning *t = findTuning(key);
+    t = (t == NULL ? findTuning(0) : t);
+    if (t != NULL) {
+      t->key = key;
+      strcpy(t->value, value);
+    }
+  }
+
+  /**
+   * Drop the cached value of a tuning variable (if any).
+   */
+  void clearTuning(const char *filename) {
+    RtcTuning *t = findTuning(rtcCrc32((const uint8_t *)filename, strlen(filename)));
+    if (t != NULL) {
+      memset(t, 0, sizeof(RtcTuning));
+    }
+  }
+
+  /**
+   * Record the imminent deep sleep and persist the block.
+   */
+  void sleeping(uint32_t time, uint32_t secs) {
+    data.sleepTime = time;
+    data.sleepSecs = secs;
+    save();
+  }
+
+  /**
+   * Expected current time after a deep sleep (0 if unknown).
+   */
+  uint32_t expectedTime() {
+    return (valid && data.sleepTime != 0 ? data.sleepTime + data.sleepSecs : 0);
+  }
+};
+
+RtcState rtcState;
+
+#endif // RTC_STATE_INC
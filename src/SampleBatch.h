@@ -0,0 +1,140 @@
+#ifndef SAMPLE_BATCH_INC
+#define SAMPLE_BATCH_INC
+
+#include <main4ino/Buffer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifndef SAMPLE_BATCH_MAX
+#define SAMPLE_BATCH_MAX 12 // amount of samples accumulated before an upload
+#endif // SAMPLE_BATCH_MAX
+
+#define SAMPLE_BATCH_MAX_OFFSET 0xFFFF
+#define SAMPLE_BATCH_BUFFER_SIZE (SAMPLE_BATCH_MAX * 12 + 16)
+
+/**
+ * Compact timestamped samples, meant to be kept in RTC memory across deep sleeps.
+ */
+struct SampleBatchData {
+  uint32_t base;  // time of the first sample
+  uint8_t count;
+  uint8_t pending; // amount of (first) samples serialized but whose upload is not confirmed yet
+  uint8_t reserved[2];
+  uint16_t offsets[SAMPLE_BATCH_MAX]; // seconds since the first sample
+  uint16_t values[SAMPLE_BATCH_MAX];
+};
+
+/**
+ * Accumulates samples over many wake cycles so that they can be uploaded at once.
+ */
+class SampleBatch {
+
+private:
+  SampleBatchData *data;
+  time_t (*clock)();
+
+public:
+  SampleBatch() {
+    data = NULL;
+    clock = NULL;
+  }
+
+  void setup(SampleBatchData *d, time_t (*c)()) {
+    data = d;
+    clock = c;
+    if (data->count > SAMPLE_BATCH_MAX || data->pending > data->count) { // should not happen, block is validated upon load
+      clear();
+    }
+  }
+
+  bool isSetup() {
+    return data != NULL;
+  }
+
+  int getCount() {
+    return data->count;
+  }
+
+  int getPending() {
+    return data->pending;
+  }
+
+  bool isFull() {
+    return data->count >= SAMPLE_BATCH_MAX;
+  }
+
+  /**
+   * Whether a sample taken now can be added.
+   */
+  bool fits() {
+    uint32_t time = clock();
+    return !isFull() && (data->count == 0 || (time >= data->base && time - data->base <= SAMPLE_BATCH_MAX_OFFSET));
+  }
+
+  void add(int value) {
+    if (!fits()) {
+      return;
+    }
+    uint32_t time = clock();
+    if (data->count == 0) {
+      data->base = time;
+    }
+    data->offsets[data->count] = time - data->base;
+    data->values[data->count] = value;
+    data->count++;
+  }
+
+  /**
+   * Value of the first sample of the batch (0 if empty).
+   */
+  int first() {
+    return (data->count == 0 ? 0 : data->values[0]);
+  }
+
+  /**
+   * Fill the buffer with the samples as "time:value,offset:value,...", all of them become pending.
+   */
+  void serialize(Buffer *b) {
+    char aux[24];
+    b->clear();
+    for (int i = 0; i < data->count; i++) {
+      if (i == 0) {
+        snprintf(aux, sizeof(aux), "%lu:%u", (unsigned long)data->base, data->values[i]);
+      } else {
+        snprintf(aux, sizeof(aux), ",%u:%u", data->offsets[i], data->values[i]);
+      }
+      b->append(aux);
+    }
+    data->pending = data->count;
+  }
+
+  /**
+   * Drop the pending samples (their upload succeeded), keep the ones added after the serialization.
+   */
+  void uploaded() {
+    int n = data->pending;
+    if (n >= data->count) {
+      clear();
+      return;
+    }
+    uint16_t shift = data->offsets[n];
+    for (int i = n; i < data->count; i++) {
+      data->offsets[i - n] = data->offsets[i] - shift;
+      data->values[i - n] = data->values[i];
+    }
+    data->base += shift;
+    data->count -= n;
+    data->pending = 0;
+  }
+
+  void clear() {
+    data->count = 0;
+    data->pending = 0;
+    data->base = 0;
+  }
+};
+
+SampleBatch vccSamples;
+
+#endif // SAMPLE_BATCH_INC
@@ -0,0 +1,110 @@
+#ifndef SCHEDULER_INC
+#define SCHEDULER_INC
+
+#include <log4ino/Log.h>
+#include <main4ino/Actor.h>
+#include <stdlib.h>
+
+#define CLASS_SCHEDULER "SC"
+
+#define SCHEDULER_NEVER 0
+#define SCHEDULER_UNKNOWN -1
+
+/**
+ * Period (in seconds) of a timing frequency of the form "~N[smhd]",
+ * SCHEDULER_NEVER if it never matches, or SCHEDULER_UNKNOWN if not supported.
+ */
+long timingPeriodSecs(const char *freq) {
+  if (strcmp(freq, "never") == 0) {
+    return SCHEDULER_NEVER;
+  } else if (freq[0] != '~') {
+    return SCHEDULER_UNKNOWN;
+  }
+  char *unit = NULL;
+  long n = strtol(freq + 1, &unit, 10);
+  if (n <= 0 || unit == freq + 1 || unit[0] == 0 || unit[1] != 0) {
+    return SCHEDULER_UNKNOWN;
+  }
+  switch (unit[0]) {
+    case 's':
+      return n;
+    case 'm':
+      return n * 60;
+    case 'h':
+      return n * 3600;
+    case 'd':
+      return n * 86400;
+    default:
+      return SCHEDULER_UNKNOWN;
+  }
+}
+
+/**
+ * Computes when the next actor is due, so that the device sleeps until then (and no wake is wasted).
+ * Periodic timings are assumed aligned to the epoch (as Timing matches them).
+ */
+class Scheduler {
+
+private:
+  long next; // seconds to the earliest due timing, SCHEDULER_UNKNOWN if not computable
+  long wakes;
+  long wasted; // wakes with no actor due
+
+public:
+  Scheduler() {
+    next = SCHEDULER_NEVER;
+    wakes = 0;
+    wasted = 0;
+  }
+
+  /**
+   * Start the computation of the next due time (to be followed by a consider per timing).
+   */
+  void reset() {
+    next = SCHEDULER_NEVER;
+  }
+
+  void consider(Timing *t, time_t time) {
+    long period = timingPeriodSecs(t->getFreq());
+    if (next == SCHEDULER_UNKNOWN || period == SCHEDULER_NEVER) {
+      return;
+    } else if (period == SCHEDULER_UNKNOWN) {
+      log(CLASS_SCHEDULER, Debug, "Unsupported: %s", t->getFreq());
+      next = SCHEDULER_UNKNOWN;
+      return;
+    }
+    long due = period - (time % period);
+    next = (next == SCHEDULER_NEVER || due < next ? due : next);
+  }
+
+  /**
+   * Seconds until the earliest due timing considered (SCHEDULER_NEVER if none, SCHEDULER_UNKNOWN if not computable).
+   */
+  long getNext() {
+    return next;
+  }
+
+  /**
+   * Account a wake, and whether any actor was due in it.
+   */
+  void woke(bool due) {
+    wakes++;
+    wasted += (due ? 0 : 1);
+  }
+
+  long getWakes() {
+    return wakes;
+  }
+
+  long getWasted() {
+    return wasted;
+  }
+
+  void report() {
+    log(CLASS_SCHEDULER, Info, "### Scheduler: wakes=%ld wasted=%ld", wakes, wasted);
+  }
+};
+
+Scheduler scheduler;
+
+#endif // SCHEDULER_INC
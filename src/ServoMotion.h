@@ -0,0 +1,195 @@
+#ifndef SERVO_MOTION_INC
+#define SERVO_MOTION_INC
+
+#include <log4ino/Log.h>
+#include <LogFormats.h>
+#include <functional>
+
+#define CLASS_SERVO_MOTION "SM"
+
+#define SERVO_MOTION_SERVOS 2 // amount of servos handled
+#define SERVO_MOTION_QUEUE 4  // amount of positions that can be queued per servo
+#define SERVO_MOTION_RANGE 180 // degrees
+
+#define SERVO_RELEASE -1 // position that means the servo can be released (detached)
+#define SERVO_UNKNOWN -1
+
+/**
+ * Non-blocking servo motion engine.
+ *
+ * Positions are queued per servo, and reached one after the other, each move lasting
+ * only the time needed to settle (fixed minimum plus time proportional to the angle travelled).
+ * Several servos move concurrently. Power is on only while any servo moves.
+ * The engine must be ticked often (from the main loop / heartbeat).
+ */
+class ServoMotion {
+
+private:
+  struct Channel {
+    int queue[SERVO_MOTION_QUEUE];
+    int head;
+    int count;
+    int position;        // last position written (SERVO_UNKNOWN if unknown)
+    bool moving;
+    unsigned long since;   // time at which the current move started (raw micros)
+    unsigned long settleUs; // time needed for the current move to settle (us)
+  };
+
+  Channel channels[SERVO_MOTION_SERVOS];
+  void (*write)(int idx, int pos);
+  std::function<void(bool)> power;
+  unsigned long (*micros)();
+  int settleMinMs;
+  int settleMsPerDegree;
+  bool powered;
+  unsigned long poweredSince; // (raw micros)
+  long lastActuationMs;
+  long totalActuationMs;
+
+  int settleMs(int from, int to) {
+    int degrees = (from == SERVO_UNKNOWN ? SERVO_MOTION_RANGE : (to > from ? to - from : from - to));
+    return settleMinMs + degrees * settleMsPerDegree;
+  }
+
+  void start(int idx, unsigned long n) {
+    Channel *c = &channels[idx];
+    int pos = c->queue[c->head];
+    c->head = (c->head + 1) % SERVO_MOTION_QUEUE;
+    c->count--;
+    if (!powered) {
+      power(true);
+      powered = true;
+      poweredSince = n;
+    }
+    logFmt(CLASS_SERVO_MOTION, Debug, LogFmtServonRotate, pos);
+    write(idx, pos);
+    c->since = n;
+    c->settleUs = (unsigned long)settleMs(c->position, pos) * 1000;
+    c->position = pos;
+    c->moving = true;
+  }
+
+public:
+  ServoMotion() {
+    for (int i = 0; i < SERVO_MOTION_SERVOS; i++) {
+      channels[i].head = 0;
+      channels[i].count = 0;
+      channels[i].position = SERVO_UNKNOWN;
+      channels[i].moving = false;
+      channels[i].since = 0;
+      channels[i].settleUs = 0;
+    }
+    write = NULL;
+    power = NULL;
+    micros = NULL;
+    settleMinMs = 0;
+    settleMsPerDegree = 0;
+    powered = false;
+    poweredSince = 0;
+    lastActuationMs = 0;
+    totalActuationMs = 0;
+  }
+
+  void setup(unsigned long (*m)(), int minMs, int msPerDegree) {
+    micros = m;
+    settleMinMs = minMs;
+    settleMsPerDegree = msPerDegree;
+  }
+
+  void setActuators(void (*w)(int idx, int pos), std::function<void(bool)> p) {
+    write = w;
+    power = p;
+  }
+
+  /**
+   * Queue a move of the given servo (returns false if it cannot be queued).
+   */
+  bool move(int idx, int pos) {
+    if (idx < 0 || idx >= SERVO_MOTION_SERVOS || write == NULL || micros == NULL) {
+      return false;
+    }
+    Channel *c = &channels[idx];
+    if (c->count >= SERVO_MOTION_QUEUE) {
+      log(CLASS_SERVO_MOTION, Warn, "Queue full: %d", idx);
+      return false;
+    }
+    c->queue[(c->head + c->count) % SERVO_MOTION_QUEUE] = pos;
+    c->count++;
+    tick();
+    return true;
+  }
+
+  /**
+   * Advance the motion, returns true if still moving.
+   *
+   * Elapsed times are computed on raw micros with unsigned subtraction, so they remain
+   * correct when micros wraps around (every ~71 minutes).
+   */
+  bool tick() {
+    if (micros == NULL || write == NULL) {
+      return false;
+    }
+    unsigned long n = micros();
+    bool busy = false;
+    for (int i = 0; i < SERVO_MOTION_SERVOS; i++) {
+      Channel *c = &channels[i];
+      if (c->moving && n - c->since >= c->settleUs) { // settled
+        c->moving = false;
+        if (c->count == 0) {
+          write(i, SERVO_RELEASE);
+        }
+      }
+      if (!c->moving && c->count > 0) {
+        start(i, n);
+      }
+      busy = busy || c->moving;
+    }
+    if (!busy && powered) {
+      power(false);
+      powered = false;
+      lastActuationMs = (n - poweredSince) / 1000;
+      totalActuationMs += lastActuationMs;
+      log(CLASS_SERVO_MOTION, Debug, "Actuation: %ldms", lastActuationMs);
+    }
+    return busy;
+  }
+
+  /**
+   * Abort any ongoing or queued motion, releasing the servos and powering them off.
+   */
+  void stop() {
+    if (write == NULL) {
+      return;
+    }
+    for (int i = 0; i < SERVO_MOTION_SERVOS; i++) {
+      Channel *c = &channels[i];
+      if (c->moving || c->count > 0) {
+        log(CLASS_SERVO_MOTION, Warn, "Aborted: %d", i);
+        write(i, SERVO_RELEASE);
+        c->position = SERVO_UNKNOWN; // move interrupted
+      }
+      c->moving = false;
+      c->count = 0;
+    }
+    tick(); // power off
+  }
+
+  bool isBusy() {
+    return powered;
+  }
+
+  /**
+   * Duration (ms) of the last motion (from power on to power off).
+   */
+  long getLastActuationMs() {
+    return lastActuationMs;
+  }
+
+  long getTotalActuationMs() {
+    return totalActuationMs;
+  }
+};
+
+ServoMotion servoMotion;
+
+#endif // SERVO_MOTION_INC
@@ -0,0 +1,121 @@
+#ifndef TELNET_SINK_INC
+#define TELNET_SINK_INC
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef TELNET_SINK_CAPACITY
+#define TELNET_SINK_CAPACITY 2048 // bytes of logs kept while waiting to be sent
+#endif // TELNET_SINK_CAPACITY
+
+#ifndef TELNET_SINK_CHUNK
+#define TELNET_SINK_CHUNK 1460 // bytes sent per write (a TCP segment on a typical MTU)
+#endif // TELNET_SINK_CHUNK
+
+/**
+ * Batched sink of log lines for a remote (telnet) client.
+ *
+ * Lines are accumulated and sent in chunks of up to a TCP segment, either once a full chunk
+ * is available or upon flush (meant to be invoked periodically).
+ * If the writer accepts less than offered (client slow or gone) the rest is kept for later
+ * (backpressure), and lines that do not fit anymore are dropped (and counted), never truncated.
+ */
+class TelnetSink {
+
+private:
+  char buffer[TELNET_SINK_CAPACITY];
+  int used;
+  long dropped;   // lines dropped
+  long sent;      // bytes sent
+  long chunks;    // writes issued
+  size_t (*writer)(const uint8_t *b, size_t l);
+
+  bool writeChunks(bool partial) { // returns false upon backpressure
+    int offset = 0;
+    bool accepted = true;
+    while (accepted && (used - offset >= TELNET_SINK_CHUNK || (partial && used - offset > 0))) {
+      int len = used - offset;
+      len = (len > TELNET_SINK_CHUNK ? TELNET_SINK_CHUNK : len);
+      int w = (int)writer((const uint8_t *)buffer + offset, len);
+      w = (w < 0 ? 0 : w);
+      offset += w;
+      sent += w;
+      chunks++;
+      accepted = (w == len);
+    }
+    memmove(buffer, buffer + offset, used - offset);
+    used -= offset;
+    return accepted;
+  }
+
+public:
+  TelnetSink() {
+    used = 0;
+    dropped = 0;
+    sent = 0;
+    chunks = 0;
+    writer = NULL;
+  }
+
+  void setup(size_t (*w)(const uint8_t *b, size_t l)) {
+    writer = w;
+  }
+
+  /**
+   * Queue a line, returns false if it had to be dropped.
+   */
+  bool append(const char *line) {
+    if (writer == NULL) {
+      return false;
+    }
+    int len = strlen(line);
+    if (used + len > TELNET_SINK_CAPACITY) {
+      writeChunks(false); // make room if the client keeps up
+    }
+    if (used + len > TELNET_SINK_CAPACITY) {
+      dropped++;
+      return false;
+    }
+    memcpy(buffer + used, line, len);
+    used += len;
+    if (used >= TELNET_SINK_CHUNK) {
+      writeChunks(false);
+    }
+    return true;
+  }
+
+  /**
+   * Send what is pending (including a last partial chunk), returns false upon backpressure.
+   */
+  bool flush() {
+    if (writer == NULL) {
+      return true;
+    }
+    return writeChunks(true);
+  }
+
+  /**
+   * Discard what is pending (for instance when the client disconnects).
+   */
+  void clear() {
+    used = 0;
+  }
+
+  int getPending() {
+    return used;
+  }
+
+  long getDropped() {
+    return dropped;
+  }
+
+  long getSent() {
+    return sent;
+  }
+
+  long getChunks() {
+    return chunks;
+  }
+};
+
+#endif // TELNET_SINK_INC
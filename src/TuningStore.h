@@ -0,0 +1,178 @@
+#ifndef TUNING_STORE_INC
+#define TUNING_STORE_INC
+
+#include <Arena.h>
+#include <log4ino/Log.h>
+#include <main4ino/Buffer.h>
+#include <string.h>
+
+#define CLASS_TUNING_STORE "TS"
+
+#ifndef TUNING_STORE_FILENAME
+#define TUNING_STORE_FILENAME "/tunings.cfg"
+#endif // TUNING_STORE_FILENAME
+
+#ifndef TUNING_STORE_MAX_LENGTH
+#define TUNING_STORE_MAX_LENGTH 256
+#endif // TUNING_STORE_MAX_LENGTH
+
+#define TUNING_STORE_SUFFIX ".tuning"
+
+/**
+ * Single packed store of tuning variables (one "filename=value" line per variable).
+ *
+ * The whole store is read with a single filesystem access upon the first lookup,
+ * and served from RAM afterwards. Every update rewrites the store.
+ */
+class TuningStore {
+
+private:
+  Buffer *blob;
+  bool (*reader)(const char *fname, Buffer *content);
+  bool (*writer)(const char *fname, const char *content);
+
+  void load() {
+    if (blob != NULL || reader == NULL) {
+      return;
+    }
+    blob = arena.make<Buffer>(TUNING_STORE_MAX_LENGTH);
+    if (!reader(TUNING_STORE_FILENAME, blob)) {
+      blob->clear();
+    }
+    log(CLASS_TUNING_STORE, Debug, "Loaded %d bytes", blob->getLength());
+  }
+
+  // Line of the given key (NULL if absent).
+  const char *find(const char *key) {
+    int keyLength = strlen(key);
+    const char *line = blob->getBuffer();
+    while (line != NULL && *line != 0) {
+      if (strncmp(line, key, keyLength) == 0 && line[keyLength] == '=') {
+        return line;
+      }
+      line = strchr(line, '\n');
+      line = (line == NULL ? NULL : line + 1);
+    }
+    return NULL;
+  }
+
+  static int lineLength(const char *s) {
+    const char *nl = strchr(s, '\n');
+    return (nl == NULL ? strlen(s) : nl - s);
+  }
+
+  // Length of the given line, including its newline if any.
+  static int fullLineLength(const char *s) {
+    return lineLength(s) + (s[lineLength(s)] == '\n' ? 1 : 0);
+  }
+
+  // Remove the given line (of the blob) from the blob.
+  void cut(const char *line) {
+    int length = fullLineLength(line);
+    char *s = blob->getUnsafeBuffer() + (line - blob->getBuffer());
+    memmove(s, s + length, strlen(s + length) + 1);
+  }
+
+public:
+  TuningStore() {
+    blob = NULL;
+    reader = NULL;
+    writer = NULL;
+  }
+
+  void setup(bool (*r)(const char *fname, Buffer *content), bool (*w)(const char *fname, const char *content)) {
+    reader = r;
+    writer = w;
+  }
+
+  /**
+   * Whether the file is a tuning variable (and hence served by this store).
+   */
+  static bool isTuning(const char *fname) {
+    int l = strlen(fname);
+    int s = strlen(TUNING_STORE_SUFFIX);
+    return l > s && strcmp(fname + l - s, TUNING_STORE_SUFFIX) == 0;
+  }
+
+  /**
+   * Retrieve the value of the given variable, returns true if present.
+   */
+  bool get(const char *key, Buffer *value) {
+    load();
+    const char *line = (blob == NULL ? NULL : find(key));
+    if (line == NULL) {
+      return false;
+    }
+    const char *v = line + strlen(key) + 1;
+    int l = lineLength(v);
+    value->clear();
+    for (int i = 0; i < l; i++) {
+      value->append(v[i]);
+    }
+    return true;
+  }
+
+  /**
+   * Retrieve the value of the given variable, migrating it to the store from its own file if not there yet
+   * (as kept by older firmwares), returns true if present.
+   */
+  bool read(const char *key, Buffer *value) {
+    if (get(key, value)) {
+      return true;
+    } else if (reader == NULL || !reader(key, value)) {
+      return false;
+    }
+    if (!value->isEmpty()) {
+      log(CLASS_TUNING_STORE, Debug, "Migrating %s", key);
+      set(key, value->getBuffer());
+    }
+    return true;
+  }
+
+  /**
+   * Set the value of the given variable (only its first line is kept) and persist the store.
+   */
+  bool set(const char *key, const char *value) {
+    load();
+    if (blob == NULL) {
+      return false;
+    }
+    const char *old = find(key);
+    int oldLength = (old == NULL ? 0 : fullLineLength(old));
+    int valueLength = lineLength(value);
+    if (blob->getLength() - oldLength + (int)strlen(key) + valueLength + 2 > TUNING_STORE_MAX_LENGTH) {
+      log(CLASS_TUNING_STORE, Warn, "Full, %s not stored", key);
+      return false;
+    }
+    if (old != NULL) { // remove the previous line
+      cut(old);
+    }
+    if (!blob->isEmpty() && blob->getBuffer()[blob->getLength() - 1] != '\n') {
+      blob->append('\n');
+    }
+    blob->append(key);
+    blob->append('=');
+    for (int i = 0; i < valueLength; i++) {
+      blob->append(value[i]);
+    }
+    blob->append('\n');
+    return writer != NULL && writer(TUNING_STORE_FILENAME, blob->getBuffer());
+  }
+
+  /**
+   * Remove the given variable and persist the store, returns false if absent (or failed to persist).
+   */
+  bool remove(const char *key) {
+    load();
+    const char *line = (blob == NULL ? NULL : find(key));
+    if (line == NULL) {
+      return false;
+    }
+    cut(line);
+    return writer != NULL && writer(TUNING_STORE_FILENAME, blob->getBuffer());
+  }
+};
+
+TuningStore tuningStore;
+
+#endif // TUNING_STORE_INC
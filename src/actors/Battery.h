@@ -2,7 +2,14 @@
 #define BATTERY_INC
 
 #include <log4ino/Log.h>
+#include <Arena.h>
 #include <main4ino/Actor.h>
+#include <EnergyMeter.h>
+#include <LogFormats.h>
+#include <PhaseTimer.h>
+#include <PropDirty.h>
+#include <RtcState.h>
+#include <SampleBatch.h>
 
 #define CLASS_BATTERY "BA"
 
@@ -10,11 +17,30 @@
 #define VCC_MVOLTS_MAX_DEFAULT 0
 #define VCC_MVOLTS_NOW_DEFAULT 3300 // 3.3v
 
+#ifndef BATTERY_VCC_EWMA_SHIFT
+#define BATTERY_VCC_EWMA_SHIFT 2 // weight of a new Vcc sample in the filter is 1/2^shift
+#endif // BATTERY_VCC_EWMA_SHIFT
+
+#ifndef BATTERY_VCC_BATCH_THRESHOLD_MV
+#define BATTERY_VCC_BATCH_THRESHOLD_MV 100 // Vcc variation that triggers an upload before the batch is full
+#endif // BATTERY_VCC_BATCH_THRESHOLD_MV
+
+#ifndef BATTERY_VCC_REPORT_THRESHOLD_MV
+#define BATTERY_VCC_REPORT_THRESHOLD_MV 20 // Vcc variation below which the status is not updated
+#endif // BATTERY_VCC_REPORT_THRESHOLD_MV
+
+#ifndef BATTERY_ENERGY_REPORT_THRESHOLD_PERCENT
+#define BATTERY_ENERGY_REPORT_THRESHOLD_PERCENT 10 // relative variation of energy figures below which the status is not updated
+#endif // BATTERY_ENERGY_REPORT_THRESHOLD_PERCENT
+
 enum BatteryProps {
-  BatteryChargeProp = 0,        // float, charge percentage
+  BatteryChargeProp = 0,        // integer, charge percentage
   BatteryVccNowProp,            // integer, measure of Vcc [mV]
   BatteryVccMaxProp,            // integer, maximum measure of Vcc [mV]
   BatteryVccMinProp,            // integer, minimum measure of Vcc [mV]
+  BatteryCycleChargeProp,       // integer, estimated charge consumed by the last wake cycle [uAh]
+  BatteryLifeProp,              // integer, projected battery life [h]
+  BatteryVccSamplesProp,        // string, batch of Vcc samples as "time:mV,offset:mV,..." (offsets in seconds)
   BatteryPropsDelimiter
 };
 
@@ -23,26 +49,108 @@ class Battery : public Actor {
 private:
   const char *name;
   Metadata *md;
-  float charge;
+  int charge;
   int vccmVoltsNow;
   int vccmVoltsMin;
   int vccmVoltsMax;
-  float (*vcc)();
+  int cycleuAh;
+  int lifeHours;
+  Buffer *vccs;
+  int (*vcc)();
+  EnergyMeter *energy;
+  SampleBatch *batch;
+  PropDirty dirty;
+
+  // The samples stay in RTC memory until a synchronization carrying them succeeds (see synced).
+  void flushSamples() {
+    batch->serialize(vccs);
+    dirty.mark(BatteryVccSamplesProp);
+    getMetadata()->changed();
+  }
+
+  void sample(int mv) {
+    if (batch == NULL || !batch->isSetup()) { // no batching, report every sample that changed the status
+      if (dirty.any()) {
+        getMetadata()->changed();
+      }
+      return;
+    }
+    if (!batch->fits() && batch->getCount() > batch->getPending()) {
+      flushSamples();
+    }
+    if (!batch->fits()) { // waiting for the upload of the batch
+      log(CLASS_BATTERY, Warn, "Batch full");
+      return;
+    }
+    batch->add(mv);
+    int variation = mv - batch->first();
+    if (batch->isFull() || variation >= BATTERY_VCC_BATCH_THRESHOLD_MV || -variation >= BATTERY_VCC_BATCH_THRESHOLD_MV) {
+      flushSamples();
+    }
+  }
 
 public:
+  /**
+   * Exponentially weighted moving average of Vcc in Q8 (24.8) fixed point.
+   */
+  static int32_t filterQ8(int32_t filteredQ8, int mv) {
+    int32_t sampleQ8 = (int32_t)mv << 8;
+    if (filteredQ8 == 0) { // no history
+      return sampleQ8;
+    }
+    return filteredQ8 + ((sampleQ8 - filteredQ8) >> BATTERY_VCC_EWMA_SHIFT);
+  }
+
+  /**
+   * Minimum variation of a value to be reported (a percentage of it, at least 1).
+   */
+  static int relativeThreshold(int v) {
+    int t = ((v < 0 ? -v : v) * BATTERY_ENERGY_REPORT_THRESHOLD_PERCENT) / 100;
+    return (t < 1 ? 1 : t);
+  }
+
+  /**
+   * Charge percentage of the current Vcc within the range observed.
+   */
+  static int chargePercentage(int mv, int mvMin, int mvMax) {
+    if (mvMax <= mvMin) {
+      return 0;
+    }
+    return ((mv - mvMin) * 100) / (mvMax - mvMin);
+  }
+
   Battery(const char *n) {
     name = n;
-    md = new Metadata(n);
+    md = arena.make<Metadata>(n);
     md->getTiming()->setFreq("~10m");
-    charge = 0.0;
+    charge = 0;
     vccmVoltsNow = VCC_MVOLTS_NOW_DEFAULT;
     vccmVoltsMin = VCC_MVOLTS_MIN_DEFAULT;
     vccmVoltsMax = VCC_MVOLTS_MAX_DEFAULT;
+    cycleuAh = 0;
+    lifeHours = 0;
+    vccs = arena.make<Buffer>(SAMPLE_BATCH_BUFFER_SIZE);
     vcc = NULL;
+    energy = NULL;
+    batch = NULL;
   }
 
-  void setup(float(*v)()){
+  void setup(int(*v)(), EnergyMeter *e, SampleBatch *b){
   	vcc = v;
+  	energy = e;
+  	batch = b;
+  	if (batch != NULL && batch->isSetup() && batch->getPending() > 0) { // upload of a previous wake cycle not confirmed
+  	  flushSamples();
+  	}
+  }
+
+  /**
+   * Properties synchronization succeeded, the samples it carried can be dropped.
+   */
+  void synced() {
+    if (batch != NULL && batch->isSetup() && batch->getPending() > 0) {
+      batch->uploaded();
+    }
   }
 
   const char *getName() {
@@ -54,20 +162,32 @@ public:
   }
 
   void act() {
+    phaseTimer.begin(PhaseAct);
     if (md->getTiming()->matches()) {
       if (vcc != NULL) {
-        float v = vcc();
-        log(CLASS_BATTERY, Debug, "Vcc: %0.3f", v);
-        vccmVoltsNow = v * 1000;
-        vccmVoltsMin = MINIM(vccmVoltsNow, vccmVoltsMin);
-        vccmVoltsMax = MAXIM(vccmVoltsNow, vccmVoltsMax);
-        charge = ((float)(vccmVoltsNow - vccmVoltsMin) / (vccmVoltsMax - vccmVoltsMin)) * 100 ;
-        log(CLASS_BATTERY, Debug, "[mvmin=%d <= mvnow=%d <= mvmax=%d]", vccmVoltsMin, vccmVoltsNow, vccmVoltsMax);
-        getMetadata()->changed();
+        int mv = vcc();
+        logFmt(CLASS_BATTERY, Debug, LogFmtBatteryVccMv, mv);
+        int32_t *filteredQ8 = &rtcState.getData()->vccFilteredQ8;
+        *filteredQ8 = filterQ8(*filteredQ8, mv);
+        int filtered = (*filteredQ8 + 128) >> 8; // rounded
+        dirty.update(BatteryVccNowProp, &vccmVoltsNow, filtered, BATTERY_VCC_REPORT_THRESHOLD_MV);
+        dirty.update(BatteryVccMinProp, &vccmVoltsMin, MINIM(filtered, vccmVoltsMin), 1);
+        dirty.update(BatteryVccMaxProp, &vccmVoltsMax, MAXIM(filtered, vccmVoltsMax), 1);
+        dirty.update(BatteryChargeProp, &charge, chargePercentage(filtered, vccmVoltsMin, vccmVoltsMax), 1);
+        logFmt(CLASS_BATTERY, Debug, LogFmtBatteryRange, vccmVoltsMin, filtered, vccmVoltsMax);
+        if (energy != NULL) {
+          int uah = energy->getCycleUah();
+          int hours = energy->getLifeHours();
+          dirty.update(BatteryCycleChargeProp, &cycleuAh, uah, relativeThreshold(cycleuAh));
+          dirty.update(BatteryLifeProp, &lifeHours, hours, relativeThreshold(lifeHours));
+          logFmt(CLASS_BATTERY, Debug, LogFmtBatteryEnergy, uah, hours);
+        }
+        sample(filtered);
       } else {
         log(CLASS_BATTERY, Warn, "No init!");
       }
     }
+    phaseTimer.end(PhaseAct);
   }
 
   const char *getPropName(int propIndex) {
@@ -80,29 +200,46 @@ public:
         return STATUS_PROP_PREFIX "mvccmax";
       case (BatteryVccMinProp):
         return STATUS_PROP_PREFIX "mvccmin";
+      case (BatteryCycleChargeProp):
+        return STATUS_PROP_PREFIX "uahcycle";
+      case (BatteryLifeProp):
+        return STATUS_PROP_PREFIX "lifeh";
+      case (BatteryVccSamplesProp):
+        return STATUS_PROP_PREFIX "vccs";
       default:
         return "";
     }
   }
 
   void getSetPropValue(int propIndex, GetSetMode m, const Value *targetValue, Value *actualValue) {
+    bool changed = false;
     switch (propIndex) {
       case (BatteryChargeProp):
-        setPropFloat(m, targetValue, actualValue, &charge);
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &charge);
         break;
       case (BatteryVccNowProp):
-        setPropInteger(m, targetValue, actualValue, &vccmVoltsNow);
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &vccmVoltsNow);
         break;
       case (BatteryVccMaxProp):
-        setPropInteger(m, targetValue, actualValue, &vccmVoltsMax);
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &vccmVoltsMax);
         break;
       case (BatteryVccMinProp):
-        setPropInteger(m, targetValue, actualValue, &vccmVoltsMin);
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &vccmVoltsMin);
+        break;
+      case (BatteryCycleChargeProp):
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &cycleuAh);
+        break;
+      case (BatteryLifeProp):
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &lifeHours);
+        break;
+      case (BatteryVccSamplesProp):
+        changed = setPropValueTracked(m, targetValue, actualValue, vccs);
         break;
       default:
         break;
     }
-    if (m != GetValue) {
+    if (changed) {
+      dirty.mark(propIndex);
       getMetadata()->changed();
     }
   }
@@ -111,6 +248,10 @@ public:
     return md;
   }
 
+  PropDirty *getDirtyProps() {
+    return &dirty;
+  }
+
 };
 
 #endif // BATTERY_INC
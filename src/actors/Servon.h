@@ -2,13 +2,17 @@
 #define SERVON_INC
 
 #include <log4ino/Log.h>
+#include <Arena.h>
 #include <main4ino/Actor.h>
-#include <functional>
+#include <PhaseTimer.h>
+#include <PropDirty.h>
+#include <ServoMotion.h>
 
 #define CLASS_SERVON "SE"
 
 enum ServonProps {
   ServonFreqProp = 0,   // frequency of synchronization
+  ServonActuationProp,  // integer, duration of the last motion (power on to power off) [ms]
   ServonPropsDelimiter
 };
 
@@ -17,21 +21,21 @@ class Servon : public Actor {
 private:
   const char *name;
   Metadata *md;
-  std::function<void (int d)> rotate;
-  std::function<void (bool b)> enable;
+  ServoMotion *motion;
+  int actuationMs;
+  PropDirty dirty;
 
 public:
   Servon(const char *n) {
     name = n;
-    md = new Metadata(n);
+    md = arena.make<Metadata>(n);
     md->getTiming()->setFreq("~1m");
-    rotate = NULL;
-    enable = NULL;
+    motion = NULL;
+    actuationMs = 0;
   }
 
-  void setup(std::function<void (int d)> r, std::function<void (int d)> e){
-  	rotate = r;
-  	enable = e;
+  void setup(ServoMotion *m){
+  	motion = m;
   }
 
   const char *getName() {
@@ -43,38 +47,48 @@ public:
   }
 
   void act() {
+    phaseTimer.begin(PhaseAct);
     if (md->getTiming()->matches()) {
       log(CLASS_SERVON, Debug, "Act!");
-      if (rotate != NULL) {
-        enable(true);
+      if (motion != NULL) {
+        if (dirty.update(ServonActuationProp, &actuationMs, motion->getLastActuationMs(), 1)) { // motion queued below completes asynchronously
+          getMetadata()->changed();
+        }
         for (int i = 0; i <= 180; i = i + 90) {
-          rotate(i);
+          motion->move(0, i);
         }
-        enable(false);
       } else {
         log(CLASS_SERVON, Warn, "No init!");
       }
     }
+    phaseTimer.end(PhaseAct);
   }
 
 public: const char *getPropName(int propIndex) {
     switch (propIndex) {
       case (ServonFreqProp):
         return ADVANCED_PROP_PREFIX "freq";
+      case (ServonActuationProp):
+        return STATUS_PROP_PREFIX "actms";
       default:
         return "";
     }
   }
 
 public: void getSetPropValue(int propIndex, GetSetMode m, const Value *targetValue, Value *actualValue) {
+    bool changed = false;
     switch (propIndex) {
       case (ServonFreqProp): {
-        setPropTiming(m, targetValue, actualValue, md->getTiming());
+        changed = setPropTimingTracked(m, targetValue, actualValue, md->getTiming());
       } break;
+      case (ServonActuationProp):
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &actuationMs);
+        break;
       default:
         break;
     }
-    if (m != GetValue) {
+    if (changed) {
+      dirty.mark(propIndex);
       getMetadata()->changed();
     }
   }
@@ -84,6 +98,10 @@ public: void getSetPropValue(int propIndex, GetSetMode m, const Value *targetVal
     return md;
   }
 
+  PropDirty *getDirtyProps() {
+    return &dirty;
+  }
+
 };
 
 #endif // SERVON_INC
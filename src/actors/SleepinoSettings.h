@@ -2,7 +2,11 @@
 #define MODULE_SETTINGS_INC
 
 #include <log4ino/Log.h>
+#include <Arena.h>
+#include <MemoryMeter.h>
 #include <main4ino/Actor.h>
+#include <PhaseTimer.h>
+#include <PropDirty.h>
 
 #define STATUS_BUFFER_SIZE 64
 #define CLASS_SLEEPINO_SETTINGS "SL"
@@ -17,6 +21,8 @@ enum SleepinoSettingsProps {
   SleepinoSettingsLsDurationSecsProp,// integer, duration to light sleep
   SleepinoSettingsWifiSsidBackupProp,// string, ssid for backup wifi network
   SleepinoSettingsWifiPassBackupProp,// string, pass for backup wifi network
+  SleepinoSettingsPhasesProp,        // string, duration of the phases of the last wake cycle (ms)
+  SleepinoSettingsMemoryProp,        // string, minimum free heap, largest free block and free stack of the wake cycle (bytes)
   SleepinoSettingsPropsDelimiter
 };
 
@@ -31,22 +37,27 @@ private:
   int lightSleepDurationSecs;
   Buffer *ssidb;
   Buffer *passb;
+  Buffer *phases;
+  Buffer *memory;
   Metadata *md;
+  PropDirty dirty;
   void (*command)(const char*);
 
 public:
   SleepinoSettings(const char *n) {
     name = n;
     lcdLogs = true;
-    status = new Buffer(STATUS_BUFFER_SIZE);
+    status = arena.make<Buffer>(STATUS_BUFFER_SIZE);
     fsLogs = true;
     fsLogsLength = DEFAULT_FS_LOGS_LENGTH;
     lightSleepDurationSecs = DEFAULT_LS_DURATION_SECS;
-    ssidb = new Buffer(20);
+    ssidb = arena.make<Buffer>(20);
     ssidb->load("defaultssid");
-    passb = new Buffer(20);
+    passb = arena.make<Buffer>(20);
     passb->load("defaultssid");
-    md = new Metadata(n);
+    phases = arena.make<Buffer>(PHASES_BUFFER_SIZE);
+    memory = arena.make<Buffer>(MEMORY_BUFFER_SIZE);
+    md = arena.make<Metadata>(n);
     md->getTiming()->setFreq("~24h");
     command = NULL;
   }
@@ -81,42 +92,65 @@ public:
         return SENSITIVE_PROP_PREFIX "ssidb";
       case (SleepinoSettingsWifiPassBackupProp):
         return SENSITIVE_PROP_PREFIX "passb";
+      case (SleepinoSettingsPhasesProp):
+        return STATUS_PROP_PREFIX "phases";
+      case (SleepinoSettingsMemoryProp):
+        return STATUS_PROP_PREFIX "mem";
       default:
         return "";
     }
   }
 
   void getSetPropValue(int propIndex, GetSetMode m, const Value *targetValue, Value *actualValue) {
+    bool changed = false;
     switch (propIndex) {
       case (SleepinoSettingsLcdLogsProp):
-        setPropBoolean(m, targetValue, actualValue, &lcdLogs);
+        changed = setPropBooleanTracked(m, targetValue, actualValue, &lcdLogs);
         break;
       case (SleepinoSettingsStatusProp):
-        setPropValue(m, targetValue, actualValue, status);
+        changed = setPropValueTracked(m, targetValue, actualValue, status);
         break;
       case (SleepinoSettingsFsLogsProp):
-        setPropBoolean(m, targetValue, actualValue, &fsLogs);
+        changed = setPropBooleanTracked(m, targetValue, actualValue, &fsLogs);
         break;
       case (SleepinoSettingsFsLengthLogsProp):
-        setPropInteger(m, targetValue, actualValue, &fsLogsLength);
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &fsLogsLength);
         break;
       case (SleepinoSettingsLsDurationSecsProp):
-        setPropInteger(m, targetValue, actualValue, &lightSleepDurationSecs);
+        changed = setPropIntegerTracked(m, targetValue, actualValue, &lightSleepDurationSecs);
         break;
       case (SleepinoSettingsWifiSsidBackupProp):
-        setPropValue(m, targetValue, actualValue, ssidb);
+        changed = setPropValueTracked(m, targetValue, actualValue, ssidb);
         break;
       case (SleepinoSettingsWifiPassBackupProp):
-        setPropValue(m, targetValue, actualValue, passb);
+        changed = setPropValueTracked(m, targetValue, actualValue, passb);
+        break;
+      case (SleepinoSettingsPhasesProp):
+        changed = setPropValueTracked(m, targetValue, actualValue, phases);
+        break;
+      case (SleepinoSettingsMemoryProp):
+        changed = setPropValueTracked(m, targetValue, actualValue, memory);
         break;
       default:
         break;
     }
-    if (m != GetValue) {
-      getMetadata()->changed();
+    if (changed) {
+      changedProp(propIndex);
     }
   }
 
+  /**
+   * Flag a prop as changed (to be synchronized).
+   */
+  void changedProp(int propIndex) {
+    dirty.mark(propIndex);
+    getMetadata()->changed();
+  }
+
+  PropDirty *getDirtyProps() {
+    return &dirty;
+  }
+
   Metadata *getMetadata() {
     return md;
   }
@@ -148,6 +182,14 @@ public:
   Buffer *getBackupWifiPass() {
     return passb;
   }
+
+  Buffer *getPhases() {
+    return phases;
+  }
+
+  Buffer *getMemory() {
+    return memory;
+  }
 };
 
 #endif // MODULE_SETTINGS_INC
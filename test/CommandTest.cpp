@@ -0,0 +1,66 @@
+#ifdef UNIT_TEST
+
+// Auxiliary libraries
+#include <unity.h>
+
+// Library being tested
+#include <Command.h>
+
+void setUp(void) {}
+
+void tearDown() {}
+
+void test_command_dispatch() {
+  TEST_ASSERT_TRUE(commandHash("rm") == commandHash("rm /alias.tuning")); // name only
+  TEST_ASSERT_TRUE(commandHash("rm") != commandHash("ls"));
+  TEST_ASSERT_TRUE(commandIs("rm /alias.tuning", "rm"));
+  TEST_ASSERT_TRUE(commandIs("rm", "rm"));
+  TEST_ASSERT_FALSE(commandIs("rmx /alias.tuning", "rm"));
+  TEST_ASSERT_FALSE(commandIs("r", "rm"));
+}
+
+void test_command_args_tokens() {
+  const char *line = "  set  alias dev1 ";
+  CommandArgs args(line);
+  const char *token = args.next();
+  TEST_ASSERT_TRUE(commandIs(token, "set"));
+  TEST_ASSERT_TRUE(commandIs(args.next(), "alias"));
+  TEST_ASSERT_TRUE(commandIs(args.next(), "dev1"));
+  TEST_ASSERT_NULL(args.next());
+  TEST_ASSERT_NULL(args.next());
+  TEST_ASSERT_EQUAL_STRING("  set  alias dev1 ", line); // input left untouched
+}
+
+void test_command_args_integers() {
+  CommandArgs args("move 1 -90 x");
+  int v = 0;
+  args.next();
+  TEST_ASSERT_TRUE(args.nextInt(&v));
+  TEST_ASSERT_EQUAL(1, v);
+  TEST_ASSERT_TRUE(args.nextInt(&v));
+  TEST_ASSERT_EQUAL(-90, v);
+  TEST_ASSERT_TRUE(args.nextInt(&v));
+  TEST_ASSERT_EQUAL(0, v); // not a number
+  TEST_ASSERT_FALSE(args.nextInt(&v));
+}
+
+void test_command_args_rest() {
+  CommandArgs args("save /alias.tuning my  device ");
+  args.next();
+  args.next();
+  TEST_ASSERT_EQUAL_STRING("my  device ", args.rest());
+  CommandArgs none("save ");
+  none.next();
+  TEST_ASSERT_NULL(none.rest());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_command_dispatch);
+  RUN_TEST(test_command_args_tokens);
+  RUN_TEST(test_command_args_integers);
+  RUN_TEST(test_command_args_rest);
+  return (UNITY_END());
+}
+
+#endif // UNIT_TEST
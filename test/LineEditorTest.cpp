@@ -0,0 +1,102 @@
+#ifdef UNIT_TEST
+
+// Auxiliary libraries
+#include <unity.h>
+
+// Library being tested
+#include <LineEditor.h>
+
+LineEditor *editor = NULL;
+
+void setUp(void) {
+  static LineEditor e;
+  e = LineEditor(); // fresh editor (empty history)
+  editor = &e;
+}
+
+void tearDown() {}
+
+bool feed(const char *s) {
+  bool available = false;
+  while (*s != 0) {
+    available = editor->feed(*s++);
+  }
+  return available;
+}
+
+void test_line_editor_completes_lines() {
+  TEST_ASSERT_FALSE(feed("help"));
+  TEST_ASSERT_TRUE(feed("\r\n"));
+  TEST_ASSERT_EQUAL_STRING("help", editor->getLine());
+  TEST_ASSERT_TRUE(feed("ignored")); // input ignored until the line is consumed
+  TEST_ASSERT_EQUAL_STRING("help", editor->getLine());
+  editor->consume();
+  TEST_ASSERT_FALSE(editor->hasLine());
+  TEST_ASSERT_FALSE(feed("\n")); // empty lines ignored
+}
+
+void test_line_editor_edits_lines() {
+  TEST_ASSERT_TRUE(feed("lss\b\n"));
+  TEST_ASSERT_EQUAL_STRING("ls", editor->getLine());
+  editor->consume();
+  TEST_ASSERT_TRUE(feed("rmm\x7f \x15info\n")); // delete and line kill
+  TEST_ASSERT_EQUAL_STRING("info", editor->getLine());
+  editor->consume();
+  TEST_ASSERT_TRUE(feed("\b\bx\n")); // backspace on empty line
+  TEST_ASSERT_EQUAL_STRING("x", editor->getLine());
+}
+
+void test_line_editor_browses_history() {
+  feed("first\n");
+  editor->consume();
+  feed("second\n");
+  editor->consume();
+  feed("second\n"); // repetitions are not kept
+  editor->consume();
+  TEST_ASSERT_TRUE(feed("\x1b[A\n")); // up
+  TEST_ASSERT_EQUAL_STRING("second", editor->getLine());
+  editor->consume();
+  TEST_ASSERT_TRUE(feed("\x1b[A\x1b[A\x1b[A\n")); // up beyond the oldest line
+  TEST_ASSERT_EQUAL_STRING("first", editor->getLine());
+  editor->consume();
+  TEST_ASSERT_TRUE(feed("\x1b[A\x1b[A\x1b[Bx\n")); // up, up, down (newest line is now first)
+  TEST_ASSERT_EQUAL_STRING("firstx", editor->getLine());
+  editor->consume();
+  TEST_ASSERT_TRUE(feed("y\x1b[2~\x1bOAz\n")); // other sequences ignored, SS3 arrows supported
+  TEST_ASSERT_EQUAL_STRING("firstxz", editor->getLine());
+}
+
+void test_line_editor_keeps_a_bounded_history() {
+  char line[8];
+  for (int i = 0; i < LINE_EDITOR_HISTORY + 2; i++) {
+    snprintf(line, sizeof(line), "cmd%d\n", i);
+    feed(line);
+    editor->consume();
+  }
+  for (int i = 0; i < LINE_EDITOR_HISTORY + 2; i++) {
+    feed("\x1b[A");
+  }
+  TEST_ASSERT_TRUE(feed("\n"));
+  snprintf(line, sizeof(line), "cmd%d", 2); // oldest line kept
+  TEST_ASSERT_EQUAL_STRING(line, editor->getLine());
+}
+
+void test_line_editor_bounds_lines() {
+  for (int i = 0; i < LINE_EDITOR_MAX_LENGTH + 10; i++) {
+    editor->feed('a');
+  }
+  TEST_ASSERT_TRUE(feed("\n"));
+  TEST_ASSERT_EQUAL(LINE_EDITOR_MAX_LENGTH, (int)strlen(editor->getLine()));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_line_editor_completes_lines);
+  RUN_TEST(test_line_editor_edits_lines);
+  RUN_TEST(test_line_editor_browses_history);
+  RUN_TEST(test_line_editor_keeps_a_bounded_history);
+  RUN_TEST(test_line_editor_bounds_lines);
+  return (UNITY_END());
+}
+
+#endif // UNIT_TEST
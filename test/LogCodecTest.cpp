@@ -0,0 +1,92 @@
+#ifdef UNIT_TEST
+
+// Auxiliary libraries
+#include <unity.h>
+
+// Library being tested
+#include <LogCodec.h>
+
+#define LINE_LENGTH 128
+
+char rec[LOG_DEFERRED_MAX_LENGTH];
+char line[LINE_LENGTH];
+
+void setUp(void) {
+  rec[0] = 0;
+  line[0] = 0;
+}
+
+void tearDown() {}
+
+void encode(const char *clz, int level, int id, ...) {
+  va_list args;
+  va_start(args, id);
+  int n = logEncodeRecord(rec, sizeof(rec) - 1, clz, level, id, args);
+  va_end(args);
+  rec[n] = 0;
+}
+
+void test_log_codec_encodes_in_hexadecimal() {
+  char out[2 * sizeof(long) + 2];
+  out[logEncodeHex(out, 0)] = 0;
+  TEST_ASSERT_EQUAL_STRING("0", out);
+  out[logEncodeHex(out, 3300)] = 0;
+  TEST_ASSERT_EQUAL_STRING("ce4", out);
+  out[logEncodeHex(out, -26)] = 0;
+  TEST_ASSERT_EQUAL_STRING("-1a", out);
+}
+
+void test_log_codec_encodes_records() {
+  encode("BA", 2, LogFmtBatteryVccMv, 3300);
+  TEST_ASSERT_EQUAL_STRING("~BA,2,5:ce4", rec);
+  encode("PL", 4, LogFmtPlatformMessage, 1, -2, "a,b\nc");
+  TEST_ASSERT_EQUAL_STRING("~PL,4,4:1,-2,a b c", rec); // separators in strings replaced
+}
+
+void test_log_codec_decodes_records() {
+  encode("BA", 1, LogFmtBatteryRange, 3000, 3300, 4200);
+  TEST_ASSERT_TRUE(logDecodeRecord(rec, line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("BA 1 [mvmin=3000 <= mvnow=3300 <= mvmax=4200]", line);
+  encode("PL", 4, LogFmtPlatformMessage, 1, -2, "hello");
+  TEST_ASSERT_TRUE(logDecodeRecord(rec, line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("PL 4 Msg(1,-2):hello", line);
+}
+
+void test_log_codec_decodes_floats() {
+  TEST_ASSERT_EQUAL_FLOAT(3.3f, logDecodeFloat("40533333"));
+  char out[2 * sizeof(long) + 2];
+  out[logEncodeFloat(out, -1.5f)] = 0;
+  TEST_ASSERT_EQUAL_FLOAT(-1.5f, logDecodeFloat(out));
+}
+
+void test_log_codec_decodes_levels_in_hexadecimal() {
+  TEST_ASSERT_TRUE(logDecodeRecord("~XX,c,3:5a", line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("XX 12 rotate(90)", line);
+}
+
+void test_log_codec_rejects_invalid_records() {
+  TEST_ASSERT_FALSE(logDecodeRecord("BA,1,5:ce4", line, sizeof(line))); // no mark
+  TEST_ASSERT_FALSE(logDecodeRecord("~BA,1", line, sizeof(line)));      // truncated
+  TEST_ASSERT_FALSE(logDecodeRecord("~BA,1,ff:0", line, sizeof(line))); // unknown format
+}
+
+void test_log_codec_truncates_decoded_lines() {
+  char shortLine[8];
+  encode("BA", 1, LogFmtBatteryVccMv, 3300);
+  TEST_ASSERT_TRUE(logDecodeRecord(rec, shortLine, sizeof(shortLine)));
+  TEST_ASSERT_EQUAL_STRING("BA 1 Vc", shortLine);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_log_codec_encodes_in_hexadecimal);
+  RUN_TEST(test_log_codec_encodes_records);
+  RUN_TEST(test_log_codec_decodes_records);
+  RUN_TEST(test_log_codec_decodes_floats);
+  RUN_TEST(test_log_codec_decodes_levels_in_hexadecimal);
+  RUN_TEST(test_log_codec_rejects_invalid_records);
+  RUN_TEST(test_log_codec_truncates_decoded_lines);
+  return (UNITY_END());
+}
+
+#endif // UNIT_TEST
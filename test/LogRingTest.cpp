@@ -0,0 +1,93 @@
+#ifdef UNIT_TEST
+
+// Auxiliary libraries
+#include <unity.h>
+
+// Library being tested
+#include <LogRing.h>
+
+#define STORAGE_LENGTH 17 // 16 usable bytes
+
+char storage[STORAGE_LENGTH];
+LogRing ring;
+
+void setUp(void) {
+  memset(storage, '#', sizeof(storage));
+  ring = LogRing(); // dropped records are counted since boot
+  ring.setup(storage, sizeof(storage));
+}
+
+void tearDown() {}
+
+void test_log_ring_keeps_records() {
+  ring.write("a1\n", 3);
+  ring.write("b22\n", 4);
+  TEST_ASSERT_EQUAL(7, ring.getUsed());
+  TEST_ASSERT_EQUAL(0, ring.getDropped());
+  TEST_ASSERT_EQUAL_STRING("a1\nb22\n", storage); // null-terminated while linear
+}
+
+void test_log_ring_drops_oldest_records() {
+  ring.write("a1\n", 3);
+  ring.write("b22\n", 4);
+  ring.write("c333\n", 5);
+  ring.write("d4444\n", 6); // 18 bytes over 16, the oldest record goes away
+  TEST_ASSERT_EQUAL(15, ring.getUsed());
+  TEST_ASSERT_EQUAL(1, ring.getDropped());
+  ring.linearize();
+  TEST_ASSERT_EQUAL_STRING("b22\nc333\nd4444\n", storage);
+}
+
+void test_log_ring_wraps_around() {
+  ring.write("a1\n", 3);
+  ring.write("b22\n", 4);
+  ring.write("c333\n", 5);
+  ring.write("d4444\n", 6); // written across the end of the storage
+  ring.write("e5\n", 3);    // b22 goes away
+  TEST_ASSERT_EQUAL(14, ring.getUsed());
+  TEST_ASSERT_EQUAL(2, ring.getDropped());
+  ring.linearize();
+  TEST_ASSERT_EQUAL_STRING("c333\nd4444\ne5\n", storage);
+  ring.write("f6\n", 3); // still consistent once linearized
+  ring.linearize();
+  TEST_ASSERT_EQUAL_STRING("d4444\ne5\nf6\n", storage);
+}
+
+void test_log_ring_keeps_the_tail_of_long_writes() {
+  ring.write("0123456789abcdefghij\n", 21);
+  TEST_ASSERT_EQUAL(16, ring.getUsed());
+  ring.linearize();
+  TEST_ASSERT_EQUAL_STRING("56789abcdefghij\n", storage);
+}
+
+void test_log_ring_reloads_content_written_in_the_storage() {
+  strcpy(storage, "x1\ny2\n");
+  ring.reload();
+  TEST_ASSERT_EQUAL(6, ring.getUsed());
+  ring.write("z3\n", 3);
+  ring.linearize();
+  TEST_ASSERT_EQUAL_STRING("x1\ny2\nz3\n", storage);
+}
+
+void test_log_ring_clears() {
+  ring.write("a1\n", 3);
+  ring.clear();
+  TEST_ASSERT_EQUAL(0, ring.getUsed());
+  TEST_ASSERT_EQUAL_STRING("", storage);
+  ring.write("b2\n", 3);
+  ring.linearize();
+  TEST_ASSERT_EQUAL_STRING("b2\n", storage);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_log_ring_keeps_records);
+  RUN_TEST(test_log_ring_drops_oldest_records);
+  RUN_TEST(test_log_ring_wraps_around);
+  RUN_TEST(test_log_ring_keeps_the_tail_of_long_writes);
+  RUN_TEST(test_log_ring_reloads_content_written_in_the_storage);
+  RUN_TEST(test_log_ring_clears);
+  return (UNITY_END());
+}
+
+#endif // UNIT_TEST
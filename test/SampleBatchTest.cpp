@@ -0,0 +1,106 @@
+#ifdef UNIT_TEST
+
+// Auxiliary libraries
+#include <unity.h>
+
+// Library being tested
+#include <SampleBatch.h>
+
+time_t currentTime = 0;
+
+time_t testClock() {
+  return currentTime;
+}
+
+SampleBatchData data;
+SampleBatch batch;
+
+void setUp(void) {
+  memset(&data, 0, sizeof(data));
+  currentTime = 1000;
+  batch.setup(&data, testClock);
+}
+
+void tearDown() {}
+
+void test_sample_batch_serializes_samples() {
+  Buffer b(SAMPLE_BATCH_BUFFER_SIZE);
+  batch.add(3300);
+  currentTime += 60;
+  batch.add(3290);
+  TEST_ASSERT_EQUAL(2, batch.getCount());
+  TEST_ASSERT_EQUAL(3300, batch.first());
+  batch.serialize(&b);
+  TEST_ASSERT_EQUAL_STRING("1000:3300,60:3290", b.getBuffer());
+  TEST_ASSERT_EQUAL(2, batch.getPending());
+}
+
+void test_sample_batch_keeps_samples_added_after_serialization() {
+  Buffer b(SAMPLE_BATCH_BUFFER_SIZE);
+  batch.add(1);
+  currentTime += 10;
+  batch.add(2);
+  batch.serialize(&b);
+  currentTime += 10;
+  batch.add(3); // added while the upload is ongoing
+  batch.uploaded();
+  TEST_ASSERT_EQUAL(1, batch.getCount());
+  TEST_ASSERT_EQUAL(0, batch.getPending());
+  batch.serialize(&b);
+  TEST_ASSERT_EQUAL_STRING("1020:3", b.getBuffer());
+  batch.uploaded();
+  TEST_ASSERT_EQUAL(0, batch.getCount());
+}
+
+void test_sample_batch_keeps_pending_samples_if_upload_not_confirmed() {
+  Buffer b(SAMPLE_BATCH_BUFFER_SIZE);
+  batch.add(1);
+  batch.serialize(&b);
+  batch.setup(&data, testClock); // as after a deep sleep
+  TEST_ASSERT_EQUAL(1, batch.getCount());
+  TEST_ASSERT_EQUAL(1, batch.getPending());
+}
+
+void test_sample_batch_refuses_samples_when_full() {
+  for (int i = 0; i < SAMPLE_BATCH_MAX; i++) {
+    TEST_ASSERT_TRUE(batch.fits());
+    batch.add(i);
+    currentTime++;
+  }
+  TEST_ASSERT_TRUE(batch.isFull());
+  TEST_ASSERT_FALSE(batch.fits());
+  batch.add(100);
+  TEST_ASSERT_EQUAL(SAMPLE_BATCH_MAX, batch.getCount());
+}
+
+void test_sample_batch_refuses_samples_out_of_offset_range() {
+  batch.add(1);
+  currentTime += SAMPLE_BATCH_MAX_OFFSET + 1;
+  TEST_ASSERT_FALSE(batch.fits());
+  currentTime = 999; // clock went back
+  TEST_ASSERT_FALSE(batch.fits());
+}
+
+void test_sample_batch_resets_invalid_data() {
+  data.count = SAMPLE_BATCH_MAX + 1;
+  batch.setup(&data, testClock);
+  TEST_ASSERT_EQUAL(0, batch.getCount());
+  data.count = 1;
+  data.pending = 2;
+  batch.setup(&data, testClock);
+  TEST_ASSERT_EQUAL(0, batch.getCount());
+  TEST_ASSERT_EQUAL(0, batch.getPending());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_sample_batch_serializes_samples);
+  RUN_TEST(test_sample_batch_keeps_samples_added_after_serialization);
+  RUN_TEST(test_sample_batch_keeps_pending_samples_if_upload_not_confirmed);
+  RUN_TEST(test_sample_batch_refuses_samples_when_full);
+  RUN_TEST(test_sample_batch_refuses_samples_out_of_offset_range);
+  RUN_TEST(test_sample_batch_resets_invalid_data);
+  return (UNITY_END());
+}
+
+#endif // UNIT_TEST
@@ -0,0 +1,41 @@
+#ifdef UNIT_TEST
+
+// Auxiliary libraries
+#include <unity.h>
+
+// Library being tested
+#include <Scheduler.h>
+
+void setUp(void) {}
+
+void tearDown() {}
+
+void test_timing_period_of_supported_frequencies() {
+  TEST_ASSERT_EQUAL(30, timingPeriodSecs("~30s"));
+  TEST_ASSERT_EQUAL(5 * 60, timingPeriodSecs("~5m"));
+  TEST_ASSERT_EQUAL(2 * 3600, timingPeriodSecs("~2h"));
+  TEST_ASSERT_EQUAL(86400, timingPeriodSecs("~1d"));
+  TEST_ASSERT_EQUAL(SCHEDULER_NEVER, timingPeriodSecs("never"));
+}
+
+void test_timing_period_of_unsupported_frequencies() {
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("")); // empty
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("~")); // no amount
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("~m")); // no amount
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("~5")); // no unit
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("~5w")); // unknown unit
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("~5mm")); // trailing chars
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("~0s")); // not positive
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("~-5s"));
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("5s")); // not periodic
+  TEST_ASSERT_EQUAL(SCHEDULER_UNKNOWN, timingPeriodSecs("always"));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_timing_period_of_supported_frequencies);
+  RUN_TEST(test_timing_period_of_unsupported_frequencies);
+  return (UNITY_END());
+}
+
+#endif // UNIT_TEST
@@ -0,0 +1,127 @@
+#ifdef UNIT_TEST
+
+// Auxiliary libraries
+#include <unity.h>
+
+// Library being tested
+#include <TuningStore.h>
+
+#define FILES 4
+#define FILE_LENGTH (TUNING_STORE_MAX_LENGTH + 1)
+
+// Emulated filesystem
+const char *names[FILES] = {TUNING_STORE_FILENAME, "/alias.tuning", "/pass.tuning", "/contrast.tuning"};
+char files[FILES][FILE_LENGTH];
+int writes = 0;
+
+int fileIndex(const char *fname) {
+  for (int i = 0; i < FILES; i++) {
+    if (strcmp(names[i], fname) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool readFile(const char *fname, Buffer *content) {
+  int i = fileIndex(fname);
+  if (i < 0 || files[i][0] == 0) {
+    return false;
+  }
+  content->load(files[i]);
+  return true;
+}
+
+bool writeFile(const char *fname, const char *content) {
+  int i = fileIndex(fname);
+  if (i < 0) {
+    return false;
+  }
+  strncpy(files[i], content, FILE_LENGTH - 1);
+  writes++;
+  return true;
+}
+
+TuningStore *store = NULL;
+
+void setUp(void) {
+  memset(files, 0, sizeof(files));
+  writes = 0;
+  store = arena.make<TuningStore>(); // fresh store (loaded upon first access)
+  store->setup(readFile, writeFile);
+}
+
+void tearDown() {}
+
+void test_tuning_store_recognizes_tuning_files() {
+  TEST_ASSERT_TRUE(TuningStore::isTuning("/alias.tuning"));
+  TEST_ASSERT_FALSE(TuningStore::isTuning("/alias.tuning.bak"));
+  TEST_ASSERT_FALSE(TuningStore::isTuning(".tuning"));
+  TEST_ASSERT_FALSE(TuningStore::isTuning("/settings.properties"));
+}
+
+void test_tuning_store_parses_the_store() {
+  Buffer value(32);
+  strcpy(files[0], "/alias.tuning.old=x\n/alias.tuning=dev1\n/contrast.tuning=50");
+  TEST_ASSERT_TRUE(store->get("/alias.tuning", &value));
+  TEST_ASSERT_EQUAL_STRING("dev1", value.getBuffer()); // key prefix of another key ignored
+  TEST_ASSERT_TRUE(store->get("/contrast.tuning", &value));
+  TEST_ASSERT_EQUAL_STRING("50", value.getBuffer()); // last line with no newline
+  TEST_ASSERT_FALSE(store->get("/pass.tuning", &value));
+  TEST_ASSERT_FALSE(store->get("/alias", &value));
+}
+
+void test_tuning_store_sets_values() {
+  Buffer value(32);
+  TEST_ASSERT_TRUE(store->set("/alias.tuning", "dev1\nignored"));
+  TEST_ASSERT_TRUE(store->set("/contrast.tuning", "50"));
+  TEST_ASSERT_TRUE(store->set("/alias.tuning", "dev2"));
+  TEST_ASSERT_EQUAL_STRING("/contrast.tuning=50\n/alias.tuning=dev2\n", files[0]);
+  TEST_ASSERT_TRUE(store->get("/alias.tuning", &value));
+  TEST_ASSERT_EQUAL_STRING("dev2", value.getBuffer());
+}
+
+void test_tuning_store_refuses_values_when_full() {
+  char big[TUNING_STORE_MAX_LENGTH];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = 0;
+  TEST_ASSERT_TRUE(store->set("/alias.tuning", "dev1"));
+  TEST_ASSERT_FALSE(store->set("/pass.tuning", big));
+  TEST_ASSERT_EQUAL_STRING("/alias.tuning=dev1\n", files[0]);
+}
+
+void test_tuning_store_removes_values() {
+  Buffer value(32);
+  strcpy(files[0], "/alias.tuning=dev1\n/pass.tuning=pwd\n/contrast.tuning=50\n");
+  TEST_ASSERT_TRUE(store->remove("/pass.tuning"));
+  TEST_ASSERT_EQUAL_STRING("/alias.tuning=dev1\n/contrast.tuning=50\n", files[0]);
+  TEST_ASSERT_FALSE(store->get("/pass.tuning", &value));
+  TEST_ASSERT_FALSE(store->remove("/pass.tuning"));
+  TEST_ASSERT_EQUAL(1, writes);
+}
+
+void test_tuning_store_migrates_legacy_files() {
+  Buffer value(32);
+  strcpy(files[1], "dev1\n"); // /alias.tuning kept in its own file by older firmwares
+  TEST_ASSERT_TRUE(store->read("/alias.tuning", &value));
+  TEST_ASSERT_EQUAL_STRING("dev1\n", value.getBuffer());
+  TEST_ASSERT_EQUAL_STRING("/alias.tuning=dev1\n", files[0]);
+  files[1][0] = 0; // served by the store from then on
+  TEST_ASSERT_TRUE(store->read("/alias.tuning", &value));
+  TEST_ASSERT_EQUAL_STRING("dev1", value.getBuffer());
+  TEST_ASSERT_FALSE(store->read("/pass.tuning", &value)); // neither in the store nor in its own file
+  TEST_ASSERT_EQUAL(1, writes);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tuning_store_recognizes_tuning_files);
+  RUN_TEST(test_tuning_store_parses_the_store);
+  RUN_TEST(test_tuning_store_sets_values);
+  RUN_TEST(test_tuning_store_refuses_values_when_full);
+  RUN_TEST(test_tuning_store_removes_values);
+  RUN_TEST(test_tuning_store_migrates_legacy_files);
+  return (UNITY_END());
+}
+
+#endif // UNIT_TEST